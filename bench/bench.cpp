@@ -0,0 +1,238 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include "src/util.h"
+#include "src/bfsearch.h"
+#include "src/bitboard.h"
+#include "src/floodfill.h"
+#include "src/sokoban.h"
+#include "src/corpus.h"
+
+// Fixed-seed benchmarks of the generator's hot paths. Every case is measured several times and printed as
+// one JSON object per line, so results of two builds can be diffed.
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start) {
+  return chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void report(const string& bench, const string& name, const string& unit, vector<double> samples) {
+  sort(samples.begin(), samples.end());
+  double mean = 0;
+  for (double s : samples)
+    mean += s;
+  mean /= samples.size();
+  double variance = 0;
+  for (double s : samples)
+    variance += (s - mean) * (s - mean);
+  double stddev = samples.size() > 1 ? sqrt(variance / (samples.size() - 1)) : 0;
+  double median = samples.size() % 2 ? samples[samples.size() / 2]
+      : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+  double p99 = samples[min<int>(samples.size() - 1, ceil(0.99 * samples.size()) - 1)];
+  cout << "{\"bench\": \"" << bench << "\", \"case\": \"" << name << "\", \"unit\": \"" << unit
+      << "\", \"samples\": " << samples.size() << ", \"median\": " << median << ", \"p99\": " << p99
+      << ", \"stddev\": " << stddev << "}" << endl;
+}
+
+static Table<char> makeGrid(Vec2 size, int wallChance, int seed) {
+  RandomGen random;
+  random.init(seed);
+  Table<char> level(size, '#');
+  for (Vec2 v : Rectangle(size).minusMargin(1))
+    level[v] = random.roll(wallChance) ? '#' : '.';
+  return level;
+}
+
+static void benchFloodFill(const string& name, const Table<char>& level, int samples, int reps) {
+  Rectangle bounds = level.getBounds();
+  BitBoard bits(bounds);
+  bits.load(level, bounds);
+  DistanceTable table(bounds);
+  vector<Vec2> directions = Vec2::directions4();
+  // Start in the largest component, so that sparse and dense grids fill comparable areas.
+  Vec2 from;
+  int maxReachable = 0;
+  Table<bool> seen(bounds, false);
+  for (Vec2 v : bounds)
+    if (bits.isFree(v) && !seen[v]) {
+      BfSearch search(table, bounds, v, [&](Vec2 pos) { return bits.isFree(pos);}, neighborhood4());
+      for (Vec2 w : search.getAllReachable())
+        seen[w] = true;
+      if (search.getNumReachable() > maxReachable) {
+        maxReachable = search.getNumReachable();
+        from = v;
+      }
+    }
+  vector<double> results;
+  for (int i : Range(samples)) {
+    auto start = Clock::now();
+    for (int j : Range(reps))
+      BfSearch search(table, bounds, from, [&](Vec2 pos) { return bits.isFree(pos);}, neighborhood4());
+    results.push_back(elapsed(start) * 1e9 / reps);
+  }
+  report("bfs", name, "ns/fill", results);
+  // The same fill through the std::function and vector wrapper.
+  results.clear();
+  for (int i : Range(samples)) {
+    auto start = Clock::now();
+    for (int j : Range(reps))
+      BfSearch search(table, bounds, from, [&](Vec2 pos) { return bits.isFree(pos);}, directions);
+    results.push_back(elapsed(start) * 1e9 / reps);
+  }
+  report("bfs_function", name, "ns/fill", results);
+  FloodFill floodFill(bounds);
+  for (Vec2 v : bounds)
+    floodFill.setPassable(v, bits.isFree(v));
+  results.clear();
+  for (int i : Range(samples)) {
+    auto start = Clock::now();
+    for (int j : Range(reps))
+      floodFill.fill(from);
+    results.push_back(elapsed(start) * 1e9 / reps);
+  }
+  report(FloodFill::hasAvx2() ? "floodfill_avx2" : "floodfill_scalar", name, "ns/fill", results);
+}
+
+struct MakerCase {
+  Vec2 size;
+  int boulders;
+  int rooms;
+  int positions;
+};
+
+static string getName(const MakerCase& c) {
+  return "x" + to_string(c.size.x) + "_y" + to_string(c.size.y) + "_b" + to_string(c.boulders) + "_r"
+      + to_string(c.rooms) + "_p" + to_string(c.positions);
+}
+
+// Nodes expanded per second by the pull search alone. The visited table holds one entry per expanded
+// node.
+static void benchSearch(const MakerCase& c, int samples, int iterations) {
+  vector<double> results;
+  RandomGen random;
+  random.init(1234);
+  TranspositionTable visited(c.positions);
+  for (int i : Range(samples)) {
+    long long nodes = 0;
+    double time = 0;
+    for (int j : Range(iterations)) {
+      SokobanMaker maker(random, c.size, c.boulders, c.positions);
+      maker.setNumRooms(c.rooms).setVisitedTable(visited);
+      maker.make();
+      time += maker.getSearchNanos() * 1e-9;
+      nodes += visited.getSize();
+    }
+    results.push_back(nodes / time);
+  }
+  report("search", getName(c), "nodes/s", results);
+}
+
+static void benchMake(const MakerCase& c, int samples, int iterations) {
+  vector<double> results;
+  RandomGen random;
+  random.init(4321);
+  TranspositionTable visited(c.positions);
+  for (int i : Range(samples)) {
+    auto start = Clock::now();
+    for (int j : Range(iterations)) {
+      SokobanMaker maker(random, c.size, c.boulders, c.positions);
+      maker.setNumRooms(c.rooms).setVisitedTable(visited);
+      maker.make();
+    }
+    results.push_back(iterations / elapsed(start));
+  }
+  report("make", getName(c), "iterations/s", results);
+}
+
+struct CorpusLevel {
+  int depth;
+  int seed;
+  int numBoulders;
+  Table<char> level;
+};
+
+// Writes random levels of two sizes to a corpus, and checks that reading it back returns every level,
+// sorted by depth, with the depth index pointing at the right records. Returns false if it doesn't.
+static bool benchCorpus(int numLevels) {
+  const string path = "sokoban_bench.corpus";
+  RandomGen random;
+  random.init(77);
+  vector<CorpusLevel> levels;
+  for (int i : Range(numLevels)) {
+    Vec2 size = i % 3 ? Vec2(28, 16) : Vec2(40, 24);
+    CorpusLevel l {random.get(1000), random.get(1 << 30), 0, Table<char>(size)};
+    for (Vec2 v : Rectangle(size)) {
+      l.level[v] = "#.0^@+"[random.get(6)];
+      if (l.level[v] == '0')
+        ++l.numBoulders;
+    }
+    levels.push_back(std::move(l));
+  }
+  auto start = Clock::now();
+  CorpusWriter writer;
+  if (!writer.open(path))
+    return false;
+  for (auto& l : levels)
+    writer.addLevel(l.seed, l.depth, l.level);
+  bool saved = writer.save();
+  double writeTime = elapsed(start);
+  CorpusReader reader;
+  if (!saved || !reader.open(path))
+    return false;
+  remove(path.c_str());
+  report("corpus_write", to_string(numLevels), "levels/s", {numLevels / writeTime});
+  stable_sort(levels.begin(), levels.end(), [](const CorpusLevel& a, const CorpusLevel& b) {
+    return make_tuple(a.level.getBounds().width(), a.numBoulders, a.depth)
+        < make_tuple(b.level.getBounds().width(), b.numBoulders, b.depth);
+  });
+  start = Clock::now();
+  int numRead = 0;
+  for (int i = 0; i < levels.size(); ++numRead) {
+    const CorpusLevel& first = levels[i];
+    Vec2 size = first.level.getBounds().getSize();
+    auto range = reader.getLevels(size, first.numBoulders, 0);
+    if (range.size() == 0)
+      return false;
+    for (uint64_t index = range.begin; index < range.end; ++index, ++i) {
+      const CorpusLevel& l = levels[i];
+      if (l.numBoulders != first.numBoulders || reader.getDepth(*range.group, index) != l.depth
+          || reader.getSeed(*range.group, index) != l.seed)
+        return false;
+      Table<char> level = reader.getLevel(*range.group, index);
+      for (Vec2 v : Rectangle(size))
+        if (level[v] != l.level[v])
+          return false;
+      uint64_t fromDepth = reader.getLevels(size, l.numBoulders, l.depth).begin;
+      if (fromDepth > index || reader.getDepth(*range.group, fromDepth) != l.depth
+          || (fromDepth > range.begin && reader.getDepth(*range.group, fromDepth - 1) >= l.depth))
+        return false;
+    }
+  }
+  if (numRead != reader.getNumGroups())
+    return false;
+  report("corpus_read", to_string(numLevels), "ns/level", {elapsed(start) * 1e9 / numLevels});
+  return true;
+}
+
+int main() {
+  benchFloodFill("open_28x16", makeGrid(Vec2(28, 16), 1000000, 1), 31, 2000);
+  benchFloodFill("open_60x40", makeGrid(Vec2(60, 40), 1000000, 1), 31, 500);
+  benchFloodFill("scattered_60x40", makeGrid(Vec2(60, 40), 4, 2), 31, 500);
+  benchFloodFill("dense_60x40", makeGrid(Vec2(60, 40), 3, 3), 31, 500);
+  benchSearch(MakerCase{Vec2(28, 16), 3, 3, 500}, 21, 20);
+  benchSearch(MakerCase{Vec2(60, 40), 8, 6, 20000}, 11, 1);
+  vector<MakerCase> matrix;
+  for (Vec2 size : {Vec2(28, 16), Vec2(40, 24), Vec2(60, 40)})
+    for (int boulders : {3, 6})
+      for (int rooms : {3, 6})
+        matrix.push_back(MakerCase{size, boulders, rooms, 500});
+  for (auto& c : matrix)
+    benchMake(c, 21, 10);
+  if (!benchCorpus(200000)) {
+    cerr << "Corpus round trip failed" << endl;
+    return 1;
+  }
+}
@@ -0,0 +1,55 @@
+#include "batch.h"
+
+static const size_t bufferSize = 1 << 16;
+
+BatchWriter::BatchWriter(FILE* o) : out(o) {
+}
+
+BatchWriter::~BatchWriter() {
+  fflush(out);
+}
+
+void BatchWriter::write(const string& data) {
+  lock_guard<mutex> lock(writeMutex);
+  fwrite(data.data(), 1, data.size(), out);
+}
+
+BatchBuffer::BatchBuffer(BatchWriter& w) : writer(w) {
+  buffer.reserve(bufferSize + 4096);
+}
+
+BatchBuffer::~BatchBuffer() {
+  flush();
+}
+
+void appendLevelRecord(string& out, int seed, int depth, const Table<char>& level, int pushes) {
+  Rectangle bounds = level.getBounds();
+  out += "{\"seed\":" + to_string(seed) + ",\"depth\":" + to_string(depth);
+  if (pushes >= 0)
+    out += ",\"pushes\":" + to_string(pushes);
+  out += ",\"width\":" + to_string(bounds.width()) + ",\"height\":" + to_string(bounds.height())
+      + ",\"rows\":[";
+  for (int y : bounds.getYRange()) {
+    if (y > bounds.top())
+      out += ',';
+    out += '"';
+    for (int x : bounds.getXRange())
+      out += level[Vec2(x, y)];
+    out += '"';
+  }
+  out += "]}";
+}
+
+void BatchBuffer::addLevel(int seed, int depth, const Table<char>& level, int pushes) {
+  appendLevelRecord(buffer, seed, depth, level, pushes);
+  buffer += '\n';
+  if (buffer.size() >= bufferSize)
+    flush();
+}
+
+void BatchBuffer::flush() {
+  if (!buffer.empty()) {
+    writer.write(buffer);
+    buffer.clear();
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include "util.h"
+
+// Output of --batch: one JSON record per generated level. Workers append records to their own
+// BatchBuffer, and only whole buffers are written out, so lines of different threads never interleave
+// and nothing is flushed per level.
+// Appends the JSON record of a level, without a trailing newline. Pushes is left out if it's negative.
+void appendLevelRecord(string& out, int seed, int depth, const Table<char>& level, int pushes = -1);
+
+class BatchWriter {
+  public:
+  BatchWriter(FILE* out);
+  ~BatchWriter();
+
+  void write(const string& data);
+
+  private:
+  FILE* out;
+  mutex writeMutex;
+};
+
+class BatchBuffer {
+  public:
+  BatchBuffer(BatchWriter&);
+  ~BatchBuffer();
+
+  void addLevel(int seed, int depth, const Table<char>& level, int pushes = -1);
+  void flush();
+
+  private:
+  BatchWriter& writer;
+  string buffer;
+};
@@ -1,46 +1,32 @@
 #include "bfsearch.h"
-#include <queue>
-
-const static double infinity = 1000000000;
-
-BfSearch::BfSearch(DistanceTable& t, Rectangle bounds, Vec2 from, function<bool(Vec2)> entryFun, vector<Vec2> directions) : table(t) {
-  table.clear();
-  queue<Vec2> q;
-  table.setDistance(from, 0);
-  q.push(from);
-  int numPopped = 0;
-  while (!q.empty()) {
-    ++numPopped;
-    Vec2 pos = q.front();
-    q.pop();
-    CHECK(!reachable.count(pos));
-    reachable.insert(pos);
-    for (Vec2 dir : directions) {
-      Vec2 next = pos + dir;
-      if (next.inRectangle(bounds) && table.getDistance(next) == infinity && entryFun(next)) {
-        table.setDistance(next, 0);
-        q.push(next);
-      }
-    }
-  }
+
+BfSearch::BfSearch(DistanceTable& t, Rectangle b, Vec2 from, function<bool(Vec2)> entryFun,
+    const vector<Vec2>& directions) : table(t), bounds(b) {
+  run(from, entryFun, directions);
 }
 
 bool BfSearch::isReachable(Vec2 pos) const {
-  return reachable.count(pos);
+  CHECK(table.counter == epoch);
+  return pos.inRectangle(bounds) && table.dirty[pos] == epoch;
 }
 
-const set<Vec2>& BfSearch::getAllReachable() const {
-  return reachable;
+vector<Vec2> BfSearch::getAllReachable() const {
+  CHECK(table.counter == epoch);
+  return vector<Vec2>(table.queue.begin(), table.queue.begin() + numReachable);
 }
 
-DistanceTable::DistanceTable(Rectangle bounds) : ddist(bounds), dirty(bounds, 0) {}
+int BfSearch::getNumReachable() const {
+  return numReachable;
+}
 
-double DistanceTable::getDistance(Vec2 v) const {
-  return dirty[v] < counter ? infinity : ddist[v];
+Vec2 BfSearch::getReachable(int index) const {
+  CHECK(table.counter == epoch && index < numReachable);
+  return table.queue[index];
 }
 
-void DistanceTable::setDistance(Vec2 v, double d) {
-  ddist[v] = d;
+DistanceTable::DistanceTable(Rectangle bounds) : dirty(bounds, 0), queue(bounds.area()) {}
+
+void DistanceTable::setReached(Vec2 v) {
   dirty[v] = counter;
 }
 
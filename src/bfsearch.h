@@ -1,32 +1,81 @@
 #pragma once
 
 #include <functional>
+#include <array>
 #include "util.h"
+#include "stats.h"
 
+// The storage BfSearch borrows: the cells the last search reached, stamped with its counter, and its
+// queue. Every search only needs reachability, so no distances are kept.
 class DistanceTable {
   public:
   DistanceTable(Rectangle bounds);
 
-  double getDistance(Vec2 v) const;
-  void setDistance(Vec2 v, double d);
+  void setReached(Vec2 v);
   void clear();
 
   private:
-  Table<double> ddist;
+  friend class BfSearch;
   Table<int> dirty;
   int counter = 1;
+  vector<Vec2> queue;
 };
 
 
+// Neighborhoods for the templated BfSearch constructor, in the order of Vec2::directions4() and
+// Vec2::directions8().
+constexpr array<Vec2, 4> neighborhood4() {
+  return {{ Vec2(0, 1), Vec2(1, 0), Vec2(0, -1), Vec2(-1, 0) }};
+}
 
+constexpr array<Vec2, 8> neighborhood8() {
+  return {{ Vec2(0, 1), Vec2(1, 0), Vec2(0, -1), Vec2(-1, 0), Vec2(1, 1), Vec2(1, -1), Vec2(-1, -1),
+      Vec2(-1, 1) }};
+}
+
+// The search borrows the table's storage: its results stay valid until the table is used by another
+// search, and constructing one doesn't allocate.
 class BfSearch {
   public:
-  BfSearch(DistanceTable&, Rectangle bounds, Vec2 from, function<bool(Vec2)> entryFun, vector<Vec2> directions = Vec2::directions8());
+  BfSearch(DistanceTable&, Rectangle bounds, Vec2 from, function<bool(Vec2)> entryFun,
+      const vector<Vec2>& directions = Vec2::directions8());
+  // Takes the predicate and the neighborhood by type, so the whole search inlines into the caller.
+  template <typename EntryFun, size_t N>
+  BfSearch(DistanceTable& t, Rectangle b, Vec2 from, EntryFun entryFun, const array<Vec2, N>& directions)
+      : table(t), bounds(b) {
+    run(from, entryFun, directions);
+  }
+
   bool isReachable(Vec2) const;
-  const set<Vec2>& getAllReachable() const;
+  vector<Vec2> getAllReachable() const;
+  int getNumReachable() const;
+  Vec2 getReachable(int index) const;
 
   private:
-  set<Vec2> reachable;
+  template <typename EntryFun, typename Directions>
+  void run(Vec2 from, EntryFun& entryFun, const Directions&);
   DistanceTable& table;
+  Rectangle bounds;
+  int epoch;
+  int numReachable = 0;
 };
 
+template <typename EntryFun, typename Directions>
+void BfSearch::run(Vec2 from, EntryFun& entryFun, const Directions& directions) {
+  table.clear();
+  epoch = table.counter;
+  table.setReached(from);
+  table.queue[numReachable++] = from;
+  for (int popped = 0; popped < numReachable; ++popped) {
+    Vec2 pos = table.queue[popped];
+    for (Vec2 dir : directions) {
+      Vec2 next = pos + dir;
+      if (next.inRectangle(bounds) && table.dirty[next] != epoch && entryFun(next)) {
+        table.setReached(next);
+        table.queue[numReachable++] = next;
+      }
+    }
+  }
+  STAT_ADD(bfsCellsPopped, numReachable);
+}
+
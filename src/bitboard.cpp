@@ -0,0 +1,109 @@
+#include "bitboard.h"
+
+BitPlane::BitPlane(Rectangle b, bool t) : bounds(b), transposed(t) {
+  rowLength = (transposed ? bounds.height() : bounds.width()) + 2;
+  wordsPerRow = (rowLength + 63) / 64;
+  int numRows = (transposed ? bounds.width() : bounds.height()) + 2;
+  words.resize(numRows * wordsPerRow, 0);
+}
+
+int BitPlane::getBit(Vec2 v) const {
+  CHECK(v.inRectangle(bounds.minusMargin(-1)));
+  int x = v.x - bounds.left() + 1;
+  int y = v.y - bounds.top() + 1;
+  if (transposed)
+    swap(x, y);
+  return y * wordsPerRow * 64 + x;
+}
+
+bool BitPlane::get(Vec2 v) const {
+  int bit = getBit(v);
+  return (words[bit / 64] >> (bit % 64)) & 1;
+}
+
+void BitPlane::set(Vec2 v, bool value) {
+  int bit = getBit(v);
+  if (value)
+    words[bit / 64] |= uint64_t(1) << (bit % 64);
+  else
+    words[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+}
+
+void BitPlane::clear() {
+  std::fill(words.begin(), words.end(), 0);
+}
+
+int BitPlane::runForward(Vec2 from, int limit) const {
+  int bit = getBit(from) + 1;
+  int ret = 0;
+  while (ret < limit) {
+    uint64_t w = ~(words[bit / 64] >> (bit % 64));
+    int avail = 64 - bit % 64;
+    if (w == 0 || __builtin_ctzll(w) >= avail) {
+      ret += avail;
+      bit += avail;
+    } else
+      return min(limit, ret + __builtin_ctzll(w));
+  }
+  return limit;
+}
+
+int BitPlane::runBackward(Vec2 from, int limit) const {
+  int bit = getBit(from) - 1;
+  int ret = 0;
+  while (ret < limit) {
+    uint64_t w = ~(words[bit / 64] << (63 - bit % 64));
+    int avail = bit % 64 + 1;
+    if (w == 0 || __builtin_clzll(w) >= avail) {
+      ret += avail;
+      bit -= avail;
+    } else
+      return min(limit, ret + __builtin_clzll(w));
+  }
+  return limit;
+}
+
+BitBoard::BitBoard(Rectangle b) : bounds(b), walls(b), boulders(b), area(b), freeRows(b), freeColumns(b, true) {
+}
+
+void BitBoard::load(const Table<char>& level, Rectangle workArea) {
+  for (Vec2 v : bounds) {
+    walls.set(v, level[v] != '.' && level[v] != '0');
+    boulders.set(v, level[v] == '0');
+    area.set(v, v.inRectangle(workArea));
+    updateFree(v);
+  }
+}
+
+void BitBoard::updateFree(Vec2 v) {
+  bool free = area.get(v) && !walls.get(v) && !boulders.get(v);
+  freeRows.set(v, free);
+  freeColumns.set(v, free);
+}
+
+bool BitBoard::isFree(Vec2 v) const {
+  return freeRows.get(v);
+}
+
+bool BitBoard::isBoulder(Vec2 v) const {
+  return boulders.get(v);
+}
+
+void BitBoard::moveBoulder(Vec2 from, Vec2 to) {
+  CHECK(boulders.get(from) && !boulders.get(to));
+  boulders.set(from, false);
+  boulders.set(to, true);
+  updateFree(from);
+  updateFree(to);
+}
+
+int BitBoard::freeRun(Vec2 from, Vec2 dir, int limit) const {
+  CHECK(dir.isCardinal4());
+  if (dir.x > 0)
+    return freeRows.runForward(from, limit);
+  if (dir.x < 0)
+    return freeRows.runBackward(from, limit);
+  if (dir.y > 0)
+    return freeColumns.runForward(from, limit);
+  return freeColumns.runBackward(from, limit);
+}
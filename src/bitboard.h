@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include "util.h"
+
+// A single bit per cell, stored row by row in 64-bit words. The plane has a one cell margin of zeros
+// around its bounds, so probing a neighbor of any cell inside the bounds needs no range check.
+class BitPlane {
+  public:
+  BitPlane(Rectangle bounds, bool transposed = false);
+
+  bool get(Vec2) const;
+  void set(Vec2, bool);
+  void clear();
+
+  // Number of consecutive set bits starting at the cell after 'from', going forward or backward along
+  // the storage rows (x for a normal plane, y for a transposed one), capped at 'limit'.
+  int runForward(Vec2 from, int limit) const;
+  int runBackward(Vec2 from, int limit) const;
+
+  private:
+  friend class FloodFill;
+  int getBit(Vec2) const;
+  Rectangle bounds;
+  bool transposed;
+  int rowLength;
+  int wordsPerRow;
+  vector<uint64_t> words;
+};
+
+// Packed view of the level used by the search: walls, boulders and the work area mask are kept in
+// separate planes, and the free cells (inside the mask, not a wall, not a boulder) are cached both
+// row-wise and column-wise, so that a whole pull line can be measured with a few word operations.
+class BitBoard {
+  public:
+  BitBoard(Rectangle bounds);
+
+  void load(const Table<char>& level, Rectangle workArea);
+  bool isFree(Vec2) const;
+  bool isBoulder(Vec2) const;
+  void moveBoulder(Vec2 from, Vec2 to);
+
+  // Number of consecutive free cells after 'from' in the cardinal direction 'dir', at most 'limit'.
+  int freeRun(Vec2 from, Vec2 dir, int limit) const;
+
+  private:
+  void updateFree(Vec2);
+  Rectangle bounds;
+  BitPlane walls;
+  BitPlane boulders;
+  BitPlane area;
+  BitPlane freeRows;
+  BitPlane freeColumns;
+};
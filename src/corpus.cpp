@@ -0,0 +1,315 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "corpus.h"
+
+static const char magic[8] = {'S', 'O', 'K', 'O', 'C', 'O', 'R', 'P'};
+static const uint32_t version = 1;
+
+static_assert(sizeof(CorpusHeader) == 32, "Corpus header layout changed");
+static_assert(sizeof(CorpusGroup) == 40, "Corpus group layout changed");
+
+static const char cellChars[] = "#.0^@+";
+
+static int getCellCode(char c) {
+  const char* pos = strchr(cellChars, c);
+  CHECK(c != 0 && pos);
+  return pos - cellChars;
+}
+
+static int getNumCellBytes(Vec2 size) {
+  return (size.x * size.y * 3 + 7) / 8;
+}
+
+static uint32_t getRecordSize(Vec2 size) {
+  return (8 + getNumCellBytes(size) + 3) / 4 * 4;
+}
+
+static uint64_t align8(uint64_t offset) {
+  return (offset + 7) / 8 * 8;
+}
+
+CorpusWriter::~CorpusWriter() {
+  if (log)
+    fclose(log);
+}
+
+template <typename Fun>
+uint64_t CorpusWriter::readLog(FILE* in, Fun fun) {
+  rewind(in);
+  uint64_t length = 0;
+  vector<uint8_t> record;
+  LogEntry entry;
+  while (fread(&entry, sizeof(entry), 1, in) == 1) {
+    record.resize(getRecordSize(Vec2(entry.width, entry.height)));
+    if (fread(record.data(), 1, record.size(), in) != record.size())
+      break;
+    fun(entry, record);
+    length += sizeof(entry) + record.size();
+  }
+  return length;
+}
+
+bool CorpusWriter::open(const string& p) {
+  path = p;
+  logPath = path + ".log";
+  log = fopen(logPath.c_str(), "a+b");
+  if (!log)
+    return false;
+  // A killed run can leave a partial entry at the end, which is cut off.
+  numLevels = 0;
+  uint64_t length = readLog(log, [&](const LogEntry&, const vector<uint8_t>&) { ++numLevels; });
+  if (ftruncate(fileno(log), length) != 0) {
+    fclose(log);
+    log = nullptr;
+    return false;
+  }
+  fseek(log, 0, SEEK_END);
+  return true;
+}
+
+void CorpusWriter::addLevel(int seed, int depth, const Table<char>& level) {
+  Rectangle bounds = level.getBounds();
+  vector<uint8_t> record(getRecordSize(bounds.getSize()) + 1);
+  uint32_t depth32 = depth;
+  uint32_t seed32 = seed;
+  memcpy(record.data(), &depth32, 4);
+  memcpy(record.data() + 4, &seed32, 4);
+  uint8_t* cells = record.data() + 8;
+  int numBoulders = 0;
+  int bit = 0;
+  for (int y : bounds.getYRange())
+    for (int x : bounds.getXRange()) {
+      char c = level[Vec2(x, y)];
+      if (c == '0')
+        ++numBoulders;
+      int code = getCellCode(c) << (bit % 8);
+      cells[bit / 8] |= code;
+      cells[bit / 8 + 1] |= code >> 8;
+      bit += 3;
+    }
+  record.pop_back();
+  LogEntry entry {uint16_t(bounds.width()), uint16_t(bounds.height()), uint32_t(numBoulders)};
+  lock_guard<mutex> lock(addMutex);
+  CHECK(log);
+  fwrite(&entry, sizeof(entry), 1, log);
+  fwrite(record.data(), 1, record.size(), log);
+  ++numLevels;
+}
+
+long long CorpusWriter::getNumLevels() const {
+  lock_guard<mutex> lock(addMutex);
+  return numLevels;
+}
+
+bool CorpusWriter::save() {
+  lock_guard<mutex> lock(addMutex);
+  if (!log || fflush(log) != 0)
+    return false;
+  // First pass: the number of levels of each depth in each group, which places every record.
+  map<tuple<int, int, int>, vector<uint64_t>> depthCounts;
+  readLog(log, [&](const LogEntry& entry, const vector<uint8_t>& record) {
+    uint32_t depth;
+    memcpy(&depth, record.data(), 4);
+    vector<uint64_t>& counts = depthCounts[make_tuple(entry.width, entry.height, entry.numBoulders)];
+    if (counts.size() < depth + 1)
+      counts.resize(depth + 1);
+    ++counts[depth];
+  });
+  CorpusHeader header {};
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.numGroups = depthCounts.size();
+  header.numLevels = numLevels;
+  vector<CorpusGroup> groupTable;
+  uint64_t offset = sizeof(CorpusHeader) + depthCounts.size() * sizeof(CorpusGroup);
+  for (auto& elem : depthCounts) {
+    CorpusGroup group {};
+    group.width = get<0>(elem.first);
+    group.height = get<1>(elem.first);
+    group.numBoulders = get<2>(elem.first);
+    group.recordSize = getRecordSize(Vec2(group.width, group.height));
+    group.maxDepth = elem.second.size() - 1;
+    for (uint64_t count : elem.second)
+      group.numLevels += count;
+    group.depthIndexOffset = offset;
+    offset = align8(offset + (uint64_t(group.maxDepth) + 2) * sizeof(uint64_t));
+    group.levelsOffset = offset;
+    offset = align8(offset + group.numLevels * group.recordSize);
+    groupTable.push_back(group);
+  }
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  if (ftruncate(fd, offset) != 0) {
+    ::close(fd);
+    return false;
+  }
+  void* mapped = mmap(nullptr, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+  uint8_t* out = (uint8_t*) mapped;
+  memcpy(out, &header, sizeof(header));
+  if (!groupTable.empty())
+    memcpy(out + sizeof(header), groupTable.data(), groupTable.size() * sizeof(CorpusGroup));
+  // The depth index doubles as the write cursor of each depth while the records are placed.
+  map<tuple<int, int, int>, pair<const CorpusGroup*, vector<uint64_t>>> cursors;
+  int groupIndex = 0;
+  for (auto& elem : depthCounts) {
+    const CorpusGroup& group = groupTable[groupIndex++];
+    uint64_t* depthIndex = (uint64_t*) (out + group.depthIndexOffset);
+    uint64_t first = 0;
+    for (int depth : Range(group.maxDepth + 1)) {
+      depthIndex[depth] = first;
+      first += elem.second[depth];
+    }
+    depthIndex[group.maxDepth + 1] = first;
+    cursors[elem.first] = make_pair(&group, vector<uint64_t>(depthIndex, depthIndex + group.maxDepth + 1));
+  }
+  // Second pass: records go to their slots in log order, so levels of equal depth keep their order.
+  readLog(log, [&](const LogEntry& entry, const vector<uint8_t>& record) {
+    uint32_t depth;
+    memcpy(&depth, record.data(), 4);
+    auto& cursor = cursors[make_tuple(entry.width, entry.height, entry.numBoulders)];
+    const CorpusGroup& group = *cursor.first;
+    memcpy(out + group.levelsOffset + cursor.second[depth]++ * group.recordSize, record.data(), record.size());
+  });
+  fseek(log, 0, SEEK_END);
+  bool ok = munmap(mapped, offset) == 0;
+  if (ok) {
+    fclose(log);
+    log = nullptr;
+    remove(logPath.c_str());
+  }
+  return ok;
+}
+
+// Whether count items of the given size starting at offset lie within length bytes, without overflowing.
+static bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t length) {
+  return offset <= length && count <= (length - offset) / size;
+}
+
+CorpusReader::~CorpusReader() {
+  close();
+}
+
+bool CorpusReader::open(const string& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < sizeof(CorpusHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+  data = (const uint8_t*) mapped;
+  length = info.st_size;
+  header = (const CorpusHeader*) data;
+  groups = (const CorpusGroup*) (data + sizeof(CorpusHeader));
+  bool valid = memcmp(header->magic, magic, sizeof(magic)) == 0 && header->version == version
+      && fits(sizeof(CorpusHeader), header->numGroups, sizeof(CorpusGroup), length);
+  for (int i = 0; valid && i < header->numGroups; ++i) {
+    const CorpusGroup& group = groups[i];
+    valid = group.recordSize == getRecordSize(Vec2(group.width, group.height))
+        && fits(group.depthIndexOffset, uint64_t(group.maxDepth) + 2, sizeof(uint64_t), length)
+        && fits(group.levelsOffset, group.numLevels, group.recordSize, length);
+  }
+  if (!valid)
+    close();
+  return valid;
+}
+
+void CorpusReader::close() {
+  if (data)
+    munmap((void*) data, length);
+  data = nullptr;
+  length = 0;
+  header = nullptr;
+  groups = nullptr;
+}
+
+int CorpusReader::getNumGroups() const {
+  return header ? header->numGroups : 0;
+}
+
+const CorpusGroup& CorpusReader::getGroup(int index) const {
+  CHECK(index >= 0 && index < getNumGroups());
+  return groups[index];
+}
+
+CorpusReader::LevelRange CorpusReader::getLevels(Vec2 size, int numBoulders, int minDepth) const {
+  for (int i : Range(getNumGroups())) {
+    const CorpusGroup& group = groups[i];
+    if (group.width == size.x && group.height == size.y && group.numBoulders == numBoulders) {
+      if (minDepth > int(group.maxDepth))
+        return LevelRange{&group, group.numLevels, group.numLevels};
+      const uint64_t* depthIndex = (const uint64_t*) (data + group.depthIndexOffset);
+      return LevelRange{&group, depthIndex[max(0, minDepth)], group.numLevels};
+    }
+  }
+  return LevelRange{nullptr, 0, 0};
+}
+
+bool CorpusReader::getRandomLevel(Vec2 size, int minDepth, RandomGen& random, Table<char>& level) const {
+  vector<LevelRange> ranges;
+  uint64_t total = 0;
+  for (int i : Range(getNumGroups())) {
+    const CorpusGroup& group = groups[i];
+    if (group.width == size.x && group.height == size.y) {
+      ranges.push_back(getLevels(size, group.numBoulders, minDepth));
+      total += ranges.back().size();
+    }
+  }
+  if (total == 0)
+    return false;
+  uint64_t index = uint64_t(random.getLL()) % total;
+  for (auto& range : ranges) {
+    if (index < range.size()) {
+      level = getLevel(*range.group, range.begin + index);
+      return true;
+    }
+    index -= range.size();
+  }
+  return false;
+}
+
+const uint8_t* CorpusReader::getRecord(const CorpusGroup& group, uint64_t index) const {
+  CHECK(index < group.numLevels);
+  return data + group.levelsOffset + index * group.recordSize;
+}
+
+Table<char> CorpusReader::getLevel(const CorpusGroup& group, uint64_t index) const {
+  const uint8_t* cells = getRecord(group, index) + 8;
+  Table<char> level(Vec2(group.width, group.height));
+  int bit = 0;
+  for (int y : Range(group.height))
+    for (int x : Range(group.width)) {
+      int code = cells[bit / 8] >> (bit % 8);
+      if (bit % 8 > 5)
+        code |= cells[bit / 8 + 1] << (8 - bit % 8);
+      level[Vec2(x, y)] = cellChars[code & 7];
+      bit += 3;
+    }
+  return level;
+}
+
+int CorpusReader::getDepth(const CorpusGroup& group, uint64_t index) const {
+  uint32_t depth;
+  memcpy(&depth, getRecord(group, index), 4);
+  return depth;
+}
+
+int CorpusReader::getSeed(const CorpusGroup& group, uint64_t index) const {
+  uint32_t seed;
+  memcpy(&seed, getRecord(group, index) + 4, 4);
+  return seed;
+}
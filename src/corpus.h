@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <cstdio>
+#include <map>
+#include <tuple>
+#include "util.h"
+
+// Binary level corpus, laid out so that a reader can mmap it and use it in place. All fields are
+// little-endian and naturally aligned:
+//   CorpusHeader
+//   CorpusGroup[numGroups]           one group per (width, height, boulders)
+//   per group: uint64_t[maxDepth + 2] depth index, the first record of depth >= d
+//              records sorted by ascending depth, recordSize bytes each:
+//                uint32_t depth, uint32_t seed, cells packed at 3 bits each in row-major order
+struct CorpusHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t numGroups;
+  uint64_t numLevels;
+  uint64_t reserved;
+};
+
+struct CorpusGroup {
+  uint16_t width;
+  uint16_t height;
+  uint32_t numBoulders;
+  uint32_t recordSize;
+  uint32_t maxDepth;
+  uint64_t numLevels;
+  uint64_t levelsOffset;
+  uint64_t depthIndexOffset;
+};
+
+// Collects levels from any number of threads and writes them as a corpus file. Levels are appended to
+// a log file next to the corpus as they come, so memory use doesn't grow with the number of levels.
+// save() sorts the log into the corpus with a counting sort by depth and removes it. If a run is killed
+// before that, the next writer opened on the same path keeps the levels already in the log.
+class CorpusWriter {
+  public:
+  CorpusWriter() {}
+  CorpusWriter(const CorpusWriter&) = delete;
+  ~CorpusWriter();
+
+  // Returns false if the log can't be created.
+  bool open(const string& path);
+  void addLevel(int seed, int depth, const Table<char>& level);
+  long long getNumLevels() const;
+  bool save();
+
+  private:
+  // Log entry: the group of the level, followed by its record in corpus format.
+  struct LogEntry {
+    uint16_t width;
+    uint16_t height;
+    uint32_t numBoulders;
+  };
+  // Calls fun(entry, record) for every complete entry of the log, and returns the length they take.
+  template <typename Fun>
+  static uint64_t readLog(FILE*, Fun fun);
+  string path;
+  string logPath;
+  FILE* log = nullptr;
+  long long numLevels = 0;
+  mutable mutex addMutex;
+};
+
+// Read-only view of a memory-mapped corpus. Looking up levels doesn't parse or copy anything
+// except the cells of the returned level.
+class CorpusReader {
+  public:
+  CorpusReader() {}
+  CorpusReader(const CorpusReader&) = delete;
+  ~CorpusReader();
+
+  // Returns false if the file can't be mapped or isn't a valid corpus.
+  bool open(const string& path);
+  void close();
+
+  struct LevelRange {
+    const CorpusGroup* group;
+    uint64_t begin;
+    uint64_t end;
+    uint64_t size() const { return end - begin; }
+  };
+
+  int getNumGroups() const;
+  const CorpusGroup& getGroup(int index) const;
+  // All levels of the given size and number of boulders with depth >= minDepth. The range is empty if
+  // there are none.
+  LevelRange getLevels(Vec2 size, int numBoulders, int minDepth) const;
+  // Picks uniformly among levels of the given size and any number of boulders, with depth >= minDepth.
+  // Returns false if there are none.
+  bool getRandomLevel(Vec2 size, int minDepth, RandomGen&, Table<char>& level) const;
+
+  Table<char> getLevel(const CorpusGroup&, uint64_t index) const;
+  int getDepth(const CorpusGroup&, uint64_t index) const;
+  int getSeed(const CorpusGroup&, uint64_t index) const;
+
+  private:
+  const uint8_t* getRecord(const CorpusGroup&, uint64_t index) const;
+  const uint8_t* data = nullptr;
+  size_t length = 0;
+  const CorpusHeader* header = nullptr;
+  const CorpusGroup* groups = nullptr;
+};
@@ -0,0 +1,73 @@
+#include "deadlocks.h"
+#include <queue>
+
+static const Vec2 directions[] = { Vec2(0, 1), Vec2(1, 0), Vec2(0, -1), Vec2(-1, 0) };
+
+DeadlockTable::DeadlockTable(const Table<char>& layout) : flags(layout.getBounds().minusMargin(-1), WALL) {
+  Rectangle bounds = layout.getBounds();
+  queue<Vec2> q;
+  for (Vec2 v : bounds)
+    if (layout[v] == '#' || layout[v] == '+')
+      flags[v] = WALL;
+    else if (layout[v] == '^') {
+      flags[v] = 0;
+      q.push(v);
+    } else
+      flags[v] = DEAD;
+  // The live cells are the ones a boulder can be pulled to out of a hole, ignoring other boulders.
+  while (!q.empty()) {
+    Vec2 pos = q.front();
+    q.pop();
+    for (Vec2 dir : directions) {
+      Vec2 prev = pos - dir;
+      if ((flags[prev] & DEAD) && !isWall(prev - dir)) {
+        flags[prev] &= ~DEAD;
+        q.push(prev);
+      }
+    }
+  }
+  for (Vec2 v : bounds)
+    if (!isWall(v)) {
+      if (isWall(v + Vec2(1, 0)) || isWall(v - Vec2(1, 0)))
+        flags[v] |= BLOCKED_HORIZONTALLY;
+      if (isWall(v + Vec2(0, 1)) || isWall(v - Vec2(0, 1)))
+        flags[v] |= BLOCKED_VERTICALLY;
+    }
+}
+
+bool DeadlockTable::isWall(Vec2 v) const {
+  return v.inRectangle(flags.getBounds()) ? (flags[v] & WALL) : true;
+}
+
+bool DeadlockTable::isDead(Vec2 v) const {
+  return flags[v] & DEAD;
+}
+
+bool DeadlockTable::isFrozen(Vec2 pos, const function<bool(Vec2)>& isBoulder) const {
+  Vec2 asWalls[8];
+  return isBlocked(pos, true, isBoulder, asWalls, 0) && isBlocked(pos, false, isBoulder, asWalls, 0);
+}
+
+// A boulder is blocked along an axis if there is a wall on either side, if both sides are dead cells, or
+// if a neighboring boulder on that axis is itself blocked along the other axis. While checking the
+// neighbor, the boulder is treated as a wall, which also ends cycles.
+bool DeadlockTable::isBlocked(Vec2 pos, bool horizontal, const function<bool(Vec2)>& isBoulder,
+    Vec2* asWalls, int numAsWalls) const {
+  if (flags[pos] & (horizontal ? BLOCKED_HORIZONTALLY : BLOCKED_VERTICALLY))
+    return true;
+  Vec2 dir = horizontal ? Vec2(1, 0) : Vec2(0, 1);
+  Vec2 sides[] = { pos + dir, pos - dir };
+  if (isDead(sides[0]) && isDead(sides[1]))
+    return true;
+  for (Vec2 side : sides)
+    for (int i : Range(numAsWalls))
+      if (asWalls[i] == side)
+        return true;
+  if (numAsWalls == 8)
+    return false;
+  asWalls[numAsWalls] = pos;
+  for (Vec2 side : sides)
+    if (isBoulder(side) && isBlocked(side, !horizontal, isBoulder, asWalls, numAsWalls + 1))
+      return true;
+  return false;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include "util.h"
+
+// Static analysis of a level layout, done once per layout. For every cell it stores in a single byte
+// whether a boulder there can still reach a hole, and whether walls block a boulder along each axis.
+// Walls are '#' and '+', holes are '^', and every other cell is floor.
+class DeadlockTable {
+  public:
+  DeadlockTable(const Table<char>& layout);
+
+  // A boulder on a dead cell can never be pushed into a hole.
+  bool isDead(Vec2) const;
+  // True if a boulder at the given cell can never move again, with the other boulders as given. Every
+  // frozen boulder is a deadlock, because boulders never rest on unfilled holes.
+  bool isFrozen(Vec2, const function<bool(Vec2)>& isBoulder) const;
+
+  private:
+  enum Flags : uint8_t {
+    WALL = 1,
+    DEAD = 2,
+    BLOCKED_HORIZONTALLY = 4,
+    BLOCKED_VERTICALLY = 8,
+  };
+  bool isWall(Vec2) const;
+  bool isBlocked(Vec2, bool horizontal, const function<bool(Vec2)>& isBoulder, Vec2* asWalls,
+      int numAsWalls) const;
+  Table<uint8_t> flags;
+};
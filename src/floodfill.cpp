@@ -0,0 +1,127 @@
+#include "floodfill.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FLOOD_FILL_AVX2
+#endif
+
+FloodFill::FloodFill(Rectangle b) : bounds(b), passable(b, true), reached(b, true) {
+}
+
+void FloodFill::setPassable(Vec2 v, bool value) {
+  passable.set(v, value);
+}
+
+bool FloodFill::isPassable(Vec2 v) const {
+  return passable.get(v);
+}
+
+bool FloodFill::isReached(Vec2 v) const {
+  return reached.get(v);
+}
+
+// The dilation of word i, masked with the passable cells. The margin rows and columns are never
+// passable, so bits shifted across word or row boundaries can't leak.
+static inline uint64_t grow(const uint64_t* x, const uint64_t* m, int i, int stride) {
+  uint64_t w = x[i];
+  uint64_t run = w | (((w + m[i]) ^ m[i]) & m[i]);
+  return (run | (w << 1) | (x[i - 1] >> 63) | (w >> 1) | (x[i + 1] << 63) | x[i - stride] | x[i + stride]) & m[i];
+}
+
+// One in-place pass over the words [begin, end) of the interior rows, so words later in the pass
+// already see the growth of earlier ones. Passes alternate direction, which lets growth travel across
+// the whole grid in either direction within one pass. Returns whether anything changed.
+static bool sweepScalar(uint64_t* x, const uint64_t* m, int begin, int end, int stride, bool backward) {
+  uint64_t changed = 0;
+  for (int j = begin; j < end; ++j) {
+    int i = backward ? begin + end - 1 - j : j;
+    uint64_t grown = grow(x, m, i, stride);
+    changed |= grown ^ x[i];
+    x[i] = grown;
+  }
+  return changed != 0;
+}
+
+#ifdef FLOOD_FILL_AVX2
+__attribute__((target("avx2")))
+static inline __m256i grow4(const uint64_t* x, const uint64_t* m, int i, int stride) {
+  __m256i w = _mm256_loadu_si256((const __m256i*) (x + i));
+  __m256i mask = _mm256_loadu_si256((const __m256i*) (m + i));
+  __m256i run = _mm256_or_si256(w, _mm256_and_si256(_mm256_xor_si256(_mm256_add_epi64(w, mask), mask), mask));
+  __m256i left = _mm256_or_si256(_mm256_slli_epi64(w, 1),
+      _mm256_srli_epi64(_mm256_loadu_si256((const __m256i*) (x + i - 1)), 63));
+  __m256i right = _mm256_or_si256(_mm256_srli_epi64(w, 1),
+      _mm256_slli_epi64(_mm256_loadu_si256((const __m256i*) (x + i + 1)), 63));
+  __m256i vertical = _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (x + i - stride)),
+      _mm256_loadu_si256((const __m256i*) (x + i + stride)));
+  return _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(run, vertical), _mm256_or_si256(left, right)), mask);
+}
+
+// Same as sweepScalar, four words at a time. The words left over at the end of the pass go through
+// sweepScalar.
+__attribute__((target("avx2")))
+static bool sweepAvx2(uint64_t* x, const uint64_t* m, int begin, int end, int stride, bool backward) {
+  __m256i changed = _mm256_setzero_si256();
+  int numBlocks = (end - begin) / 4;
+  for (int j = 0; j < numBlocks; ++j) {
+    int i = backward ? end - 4 * (j + 1) : begin + 4 * j;
+    __m256i grown = grow4(x, m, i, stride);
+    changed = _mm256_or_si256(changed, _mm256_xor_si256(grown, _mm256_loadu_si256((const __m256i*) (x + i))));
+    _mm256_storeu_si256((__m256i*) (x + i), grown);
+  }
+  bool ret = !_mm256_testz_si256(changed, changed);
+  if (backward)
+    return sweepScalar(x, m, begin, end - 4 * numBlocks, stride, true) || ret;
+  else
+    return sweepScalar(x, m, begin + 4 * numBlocks, end, stride, false) || ret;
+}
+#endif
+
+bool FloodFill::hasAvx2() {
+#ifdef FLOOD_FILL_AVX2
+  static bool ret = __builtin_cpu_supports("avx2");
+  return ret;
+#else
+  return false;
+#endif
+}
+
+void FloodFill::fill(Vec2 from) {
+  CHECK(passable.get(from));
+  reached.clear();
+  reached.set(from, true);
+  uint64_t* x = reached.words.data();
+  const uint64_t* m = passable.words.data();
+  int stride = reached.wordsPerRow;
+  int begin = stride;
+  int end = reached.words.size() - stride;
+  bool backward = false;
+#ifdef FLOOD_FILL_AVX2
+  if (hasAvx2()) {
+    while (sweepAvx2(x, m, begin, end, stride, backward))
+      backward = !backward;
+    return;
+  }
+#endif
+  while (sweepScalar(x, m, begin, end, stride, backward))
+    backward = !backward;
+}
+
+int FloodFill::getNumReached() const {
+  int ret = 0;
+  for (uint64_t w : reached.words)
+    ret += __builtin_popcountll(w);
+  return ret;
+}
+
+Vec2 FloodFill::getMinReached() const {
+  for (int i : All(reached.words))
+    if (uint64_t w = reached.words[i]) {
+      int bit = i * 64 + __builtin_ctzll(w);
+      int row = bit / (reached.wordsPerRow * 64);
+      int column = bit % (reached.wordsPerRow * 64);
+      return Vec2(row - 1 + bounds.left(), column - 1 + bounds.top());
+    }
+  CHECK(false);
+  return Vec2();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "util.h"
+#include "bitboard.h"
+
+// Computes the cells reachable from a seed through passable cells on whole words at a time: the reached
+// set is dilated by one cell in every direction with shifts, and masked with the passable cells, until
+// it stops changing. A run of passable cells along a word is also filled in one step with a carry
+// trick. The sweeps use AVX2 when the CPU supports it, and plain 64-bit words otherwise.
+//
+// The planes are transposed (one storage row per x), so the first reached bit in storage order is the
+// smallest reached cell in Vec2 order.
+class FloodFill {
+  public:
+  FloodFill(Rectangle bounds);
+
+  void setPassable(Vec2, bool);
+  bool isPassable(Vec2) const;
+
+  // The seed has to be passable.
+  void fill(Vec2 from);
+  bool isReached(Vec2) const;
+  int getNumReached() const;
+  // The smallest reached cell in Vec2 order.
+  Vec2 getMinReached() const;
+
+  static bool hasAvx2();
+
+  private:
+  Rectangle bounds;
+  BitPlane passable;
+  BitPlane reached;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "util.h"
+
+// Maps the cells of a grid, plus a one cell margin around it, to indices of a flat array. Cells are
+// stored column by column like in Table, but columns are padded to a power of two, so an index is a
+// shift and two adds. DynamicGeometry takes the bounds at run time, FixedGeometry at compile time,
+// which lets the compiler fold the whole computation into the addressing of the access.
+class DynamicGeometry {
+  public:
+  DynamicGeometry(Rectangle bounds) : origin(bounds.topLeft() - Vec2(1, 1)), width(bounds.width()) {
+    while ((1 << shift) < bounds.height() + 2)
+      ++shift;
+  }
+
+  int getIndex(Vec2 v) const {
+    return ((v.x - origin.x) << shift) + v.y - origin.y;
+  }
+
+  int getNumIndices() const {
+    return (width + 2) << shift;
+  }
+
+  private:
+  Vec2 origin;
+  int width;
+  int shift = 0;
+};
+
+template <int Width, int Height>
+class FixedGeometry {
+  public:
+  FixedGeometry(Rectangle bounds) {
+    CHECK(bounds == Rectangle(Width, Height));
+  }
+
+  static int getIndex(Vec2 v) {
+    return ((v.x + 1) << shift) + v.y + 1;
+  }
+
+  static constexpr int getNumIndices() {
+    return (Width + 2) << shift;
+  }
+
+  private:
+  static constexpr int getShift(int height, int s = 0) {
+    return (1 << s) >= height ? s : getShift(height, s + 1);
+  }
+  static constexpr int shift = getShift(Height + 2);
+};
@@ -0,0 +1,136 @@
+#include "heuristic.h"
+#include <queue>
+#include <limits>
+
+static const Vec2 directions[] = { Vec2(0, 1), Vec2(1, 0), Vec2(0, -1), Vec2(-1, 0) };
+
+static bool isWall(const Table<char>& layout, Vec2 v) {
+  return !v.inRectangle(layout.getBounds()) || layout[v] == '#' || layout[v] == '+';
+}
+
+PushDistances::PushDistances(const Table<char>& layout) : bounds(layout.getBounds()) {
+  for (Vec2 v : bounds)
+    if (layout[v] == '^')
+      holes.push_back(v);
+  distances.resize(bounds.area() * holes.size(), unreachable);
+  for (int hole : All(holes)) {
+    queue<Vec2> q;
+    distances[getIndex(holes[hole]) + hole] = 0;
+    q.push(holes[hole]);
+    while (!q.empty()) {
+      Vec2 pos = q.front();
+      q.pop();
+      for (Vec2 dir : directions) {
+        Vec2 prev = pos - dir;
+        if (!isWall(layout, prev) && !isWall(layout, prev - dir) && distances[getIndex(prev) + hole] == unreachable) {
+          distances[getIndex(prev) + hole] = distances[getIndex(pos) + hole] + 1;
+          q.push(prev);
+        }
+      }
+    }
+  }
+}
+
+int PushDistances::getIndex(Vec2 v) const {
+  return ((v.y - bounds.top()) * bounds.width() + v.x - bounds.left()) * holes.size();
+}
+
+int PushDistances::getNumHoles() const {
+  return holes.size();
+}
+
+int PushDistances::getDistance(Vec2 v, int hole) const {
+  return distances[getIndex(v) + hole];
+}
+
+AssignmentBound::AssignmentBound(const PushDistances& d) : distances(d) {
+}
+
+void AssignmentBound::setRow(int row, Vec2 boulder) {
+  for (int col : Range(1, size + 1)) {
+    int distance = distances.getDistance(boulder, holes[col]);
+    cost[row * (size + 1) + col] = distance == PushDistances::unreachable ? infinity : distance;
+  }
+}
+
+void AssignmentBound::reset(const vector<Vec2>& boulders, uint64_t filledHoles) {
+  size = boulders.size();
+  holes.assign(1, -1);
+  for (int hole : Range(distances.getNumHoles()))
+    if (!(filledHoles & (uint64_t(1) << hole)))
+      holes.push_back(hole);
+  CHECK(holes.size() == size + 1);
+  cost.assign((size + 1) * (size + 1), 0);
+  for (int row : Range(1, size + 1))
+    setRow(row, boulders[row - 1]);
+  u.assign(size + 1, 0);
+  v.assign(size + 1, 0);
+  match.assign(size + 1, 0);
+  way.assign(size + 1, 0);
+  minv.resize(size + 1);
+  used.resize(size + 1);
+  for (int row : Range(1, size + 1))
+    augment(row);
+}
+
+void AssignmentBound::moveBoulder(int index, Vec2 to) {
+  int row = index + 1;
+  setRow(row, to);
+  for (int col : Range(1, size + 1))
+    if (match[col] == row)
+      match[col] = 0;
+  // Lowering the row's potential keeps every reduced cost nonnegative, and the other matched edges
+  // stay tight, so one augmenting path from the freed row restores an optimal matching.
+  int minReduced = numeric_limits<int>::max();
+  for (int col : Range(1, size + 1))
+    minReduced = min(minReduced, cost[row * (size + 1) + col] - v[col]);
+  u[row] = minReduced;
+  augment(row);
+}
+
+// One phase of the Hungarian algorithm: finds a shortest augmenting path from a free row using the
+// reduced costs, and updates the potentials along the way.
+void AssignmentBound::augment(int row) {
+  const int maxValue = numeric_limits<int>::max() / 2;
+  match[0] = row;
+  int col0 = 0;
+  std::fill(minv.begin(), minv.end(), maxValue);
+  std::fill(used.begin(), used.end(), false);
+  do {
+    used[col0] = true;
+    int row0 = match[col0];
+    int delta = maxValue;
+    int col1 = 0;
+    for (int col : Range(1, size + 1))
+      if (!used[col]) {
+        int cur = cost[row0 * (size + 1) + col] - u[row0] - v[col];
+        if (cur < minv[col]) {
+          minv[col] = cur;
+          way[col] = col0;
+        }
+        if (minv[col] < delta) {
+          delta = minv[col];
+          col1 = col;
+        }
+      }
+    for (int col : Range(size + 1))
+      if (used[col]) {
+        u[match[col]] += delta;
+        v[col] -= delta;
+      } else
+        minv[col] -= delta;
+    col0 = col1;
+  } while (match[col0] != 0);
+  do {
+    int col1 = way[col0];
+    match[col0] = match[col1];
+    col0 = col1;
+  } while (col0 != 0);
+}
+
+int AssignmentBound::getCost() const {
+  int ret = 0;
+  for (int col : Range(1, size + 1))
+    ret += cost[match[col] * (size + 1) + col];
+  return ret;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include "util.h"
+
+// Push distances from every cell to every hole of a layout, ignoring other boulders. Computed once per
+// layout by pulling a boulder out of each hole. Walls are '#' and '+', holes are '^'.
+class PushDistances {
+  public:
+  PushDistances(const Table<char>& layout);
+
+  static const int unreachable = 0xffff;
+  int getNumHoles() const;
+  int getDistance(Vec2, int hole) const;
+
+  private:
+  int getIndex(Vec2) const;
+  Rectangle bounds;
+  vector<Vec2> holes;
+  vector<uint16_t> distances;
+};
+
+// Lower bound on the pushes needed to solve a position: the minimum-cost matching of boulders to unfilled
+// holes, found with the Hungarian algorithm. The dual potentials are kept, so when one boulder moves the
+// matching is repaired with a single augmenting path in O(n^2) instead of being solved again in O(n^3).
+class AssignmentBound {
+  public:
+  AssignmentBound(const PushDistances&);
+
+  // Solves the matching from scratch. There must be as many boulders as unfilled holes.
+  void reset(const vector<Vec2>& boulders, uint64_t filledHoles);
+  void moveBoulder(int index, Vec2 to);
+  // At least 'infinity' if some boulder can't be matched to a hole it can reach.
+  int getCost() const;
+  static const int infinity = 1 << 20;
+
+  private:
+  void setRow(int row, Vec2 boulder);
+  void augment(int row);
+  const PushDistances& distances;
+  int size = 0;
+  // Rows are boulders and columns are holes, both numbered from 1. Row and column 0 are the algorithm's
+  // sentinels.
+  vector<int> holes;
+  vector<int> cost;
+  vector<int> u, v, match, way, minv;
+  vector<char> used;
+};
@@ -1,8 +1,16 @@
 #include <iostream>
 #include <thread>
+#include <atomic>
+#include <chrono>
 #include "util.h"
 #include "sokoban.h"
 #include "cxxopts.h"
+#include "solver.h"
+#include "stats.h"
+#include "batch.h"
+#include "corpus.h"
+#include "server.h"
+#include "scheduler.h"
 
 using namespace std;
 
@@ -14,21 +22,306 @@ void printLevel(const Table<char>& level) {
   }
 }
 
-void trySokoban(RandomGen& randomGen, Vec2 levelSize, int numTries,
-                int numBoulders, int numMoves, int rooms, int doors) {
-  int maxDepth = -1;
-  for (int i = 0; i < numTries; ++i) {
-    SokobanMaker sokoban(randomGen, levelSize, numBoulders, numMoves);
-    sokoban.setNumRooms(rooms);
-    sokoban.setNumDoors(doors);
-    if (sokoban.make() && sokoban.getMaxDepth() > maxDepth) {
-      maxDepth = sokoban.getMaxDepth();
-      cout << "Depth reached: " << maxDepth << endl;
-      printLevel(sokoban.getResult());
+// Number of solver expansions per level when --verify is on, 0 if it's off.
+static int verifyNodes = 0;
+
+// Set by --search-threads.
+static int numSearchThreads = 1;
+
+// Set by the --weight options.
+static ScoreWeights scoreWeights;
+
+// Set by --time-limit and --iteration-time-limit, in seconds, 0 if there is no limit.
+static double timeLimit = 0;
+static double iterationTimeLimit = 0;
+// When the run started, for --time-limit.
+static chrono::steady_clock::time_point runStart;
+
+static chrono::steady_clock::duration toDuration(double seconds) {
+  return chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+}
+
+// Whether the run is out of time, so no more iterations should start.
+static bool isPastTimeLimit() {
+  return timeLimit > 0 && chrono::steady_clock::now() >= runStart + toDuration(timeLimit);
+}
+
+// Runs the --verify solver within what is left of --time-limit, and sets outOfTime if it gave up
+// because of it. A solver isn't even set up once the limit has passed.
+static int verifyLevel(const Table<char>& level, int& numExpanded, bool& outOfTime) {
+  numExpanded = 0;
+  outOfTime = isPastTimeLimit();
+  if (outOfTime)
+    return -1;
+  SokobanSolver solver(level);
+  if (timeLimit > 0)
+    solver.setDeadline(runStart + toDuration(timeLimit));
+  int pushes = solver.solve(verifyNodes);
+  numExpanded = solver.getNumExpanded();
+  outOfTime = solver.isOutOfTime();
+  return pushes;
+}
+
+void printResult(int depth, const PathFeatures& features, const Table<char>& level) {
+  cout << "Depth reached: " << depth << endl;
+  if (!scoreWeights.isDepthOnly())
+    cout << "Score: " << scoreWeights.getScore(features) << " (" << features.boxLines << " box lines, "
+        << features.boxChanges << " box changes, " << features.bouldersTouched << " boulders touched, "
+        << features.doorPulls << " door pulls)" << endl;
+  printLevel(level);
+  if (verifyNodes > 0) {
+    int numExpanded;
+    bool outOfTime;
+    int pushes = verifyLevel(level, numExpanded, outOfTime);
+    if (pushes >= 0)
+      cout << "Optimal solution: " << pushes << " pushes (" << numExpanded << " nodes expanded)" << endl;
+    else if (outOfTime)
+      cout << "No solution found within the time limit" << endl;
+    else
+      cout << "No solution found within " << verifyNodes << " nodes" << endl;
+  }
+}
+
+struct BestLevel {
+  int depth = -1;
+  int iteration = -1;
+  double score = 0;
+  PathFeatures features;
+  unique_ptr<Table<char>> level;
+
+  // Higher scores win, and equal ones go to the earlier iteration, whichever thread ran it.
+  bool isBeatenBy(double otherScore, int otherIteration) const {
+    return depth == -1 || otherScore > score || (otherScore == score && otherIteration < iteration);
+  }
+};
+
+struct WorkerStats {
+  Stats counters = Stats();
+  double tableLoad = 0;
+  double averageProbes = 0;
+  int maxProbes = 0;
+  long long numTasks = 0;
+  long long numSteals = 0;
+  double idleSeconds = 0;
+};
+
+// Set by --stats.
+static bool printStats = false;
+
+// Set by --batch.
+static BatchWriter* batchWriter = nullptr;
+// Set by --corpus.
+static CorpusWriter* corpusWriter = nullptr;
+
+static void setDeadline(SokobanMaker& sokoban) {
+  if (timeLimit <= 0 && iterationTimeLimit <= 0)
+    return;
+  auto deadline = chrono::steady_clock::time_point::max();
+  if (timeLimit > 0)
+    deadline = runStart + toDuration(timeLimit);
+  if (iterationTimeLimit > 0)
+    deadline = min(deadline, chrono::steady_clock::now() + toDuration(iterationTimeLimit));
+  sokoban.setDeadline(deadline);
+}
+
+// Set by --min-depth, 0 if any depth will do.
+static int minDepth = 0;
+// Set once a level of at least minDepth was generated, which ends the run.
+static atomic<bool> minDepthReached(false);
+
+// Whether no more iterations should start.
+static bool isRunOver() {
+  return isPastTimeLimit() || minDepthReached;
+}
+
+// Whether every generated level is output, rather than only the best one.
+static bool keepAllLevels() {
+  return batchWriter || corpusWriter;
+}
+
+// What a worker reuses from one iteration to the next. Split searches need the concurrent visited set,
+// so only the kind the searches use is allocated.
+struct WorkerArena {
+  WorkerArena(int numMoves) {
+    if (numSearchThreads > 1)
+      concurrentVisited.reset(new ConcurrentTranspositionTable(numMoves));
+    else
+      visited.reset(new TranspositionTable(numMoves));
+    if (batchWriter)
+      batch.reset(new BatchBuffer(*batchWriter));
+  }
+  RandomGen random;
+  unique_ptr<TranspositionTable> visited;
+  unique_ptr<ConcurrentTranspositionTable> concurrentVisited;
+  unique_ptr<BatchBuffer> batch;
+  BestLevel best;
+
+  void getTableStats(WorkerStats& stats) const {
+    if (concurrentVisited) {
+      stats.tableLoad = concurrentVisited->getLoad();
+      return;
     }
+    stats.tableLoad = visited->getLoad();
+    stats.averageProbes = visited->getAverageProbes();
+    stats.maxProbes = visited->getMaxProbes();
+  }
+};
+
+// Runs one iteration on the arena's generator, which the caller has seeded.
+static void runIteration(WorkerArena& arena, int seed, int iteration, bool printProgress,
+    const LevelParams& params, TaskScheduler* scheduler) {
+  SokobanMaker sokoban(arena.random, params.size, params.numBoulders, params.numNodes);
+  sokoban.setNumRooms(params.numRooms);
+  sokoban.setNumDoors(params.numDoors);
+  if (arena.concurrentVisited)
+    sokoban.setVisitedTable(*arena.concurrentVisited);
+  else
+    sokoban.setVisitedTable(*arena.visited);
+  sokoban.setScoreWeights(scoreWeights);
+  sokoban.setNumSearchThreads(numSearchThreads);
+  sokoban.setScheduler(scheduler);
+  setDeadline(sokoban);
+  if (minDepth > 0) {
+    sokoban.setMinDepth(minDepth);
+    sokoban.setStopFlag(&minDepthReached);
+  }
+  bool made = sokoban.make();
+  if (made && minDepth > 0 && sokoban.getDeepestDepth() >= minDepth)
+    minDepthReached = true;
+  if (keepAllLevels()) {
+    if (made) {
+      Table<char> level = sokoban.getResult();
+      if (arena.batch) {
+        int numExpanded;
+        bool outOfTime;
+        int pushes = verifyNodes > 0 ? verifyLevel(level, numExpanded, outOfTime) : -1;
+        arena.batch->addLevel(seed + iteration, sokoban.getMaxDepth(), level, pushes);
+      }
+      if (corpusWriter)
+        corpusWriter->addLevel(seed + iteration, sokoban.getMaxDepth(), level);
+    }
+    return;
+  }
+  BestLevel& best = arena.best;
+  if (made && best.isBeatenBy(sokoban.getBestScore(), iteration)) {
+    best.depth = sokoban.getMaxDepth();
+    best.iteration = iteration;
+    best.score = sokoban.getBestScore();
+    best.features = sokoban.getBestFeatures();
+    best.level.reset(new Table<char>(sokoban.getResult()));
+    if (printProgress)
+      printResult(best.depth, best.features, *best.level);
   }
-  if (maxDepth == -1)
+}
+
+static void printStatsSummary(const vector<WorkerStats>& stats) {
+  if (!Stats::enabled)
+    cerr << "--stats needs a build with STATS=true for the hot-path counters" << endl;
+  Stats total = Stats();
+  long long numSteals = 0;
+  double idleSeconds = 0;
+  for (int i : All(stats)) {
+    total.add(stats[i].counters);
+    numSteals += stats[i].numSteals;
+    idleSeconds += stats[i].idleSeconds;
+    cerr << "{\"thread\": " << i;
+    if (Stats::enabled)
+      cerr << ", " << stats[i].counters.getJsonFields();
+    cerr << ", \"visited_load\": " << stats[i].tableLoad
+        << ", \"visited_average_probes\": " << stats[i].averageProbes
+        << ", \"visited_max_probes\": " << stats[i].maxProbes
+        << ", \"tasks\": " << stats[i].numTasks
+        << ", \"steals\": " << stats[i].numSteals
+        << ", \"idle_seconds\": " << stats[i].idleSeconds << "}" << endl;
+  }
+  cerr << "{\"run\": true, \"threads\": " << stats.size();
+  if (Stats::enabled)
+    cerr << ", " << total.getJsonFields();
+  cerr << ", \"steals\": " << numSteals << ", \"idle_seconds\": " << idleSeconds << "}" << endl;
+}
+
+// Once --time-limit passes, or a level reaches --min-depth, the searches in progress stop with their
+// best state so far and no new iterations start, so the best level found until then is printed.
+// Returns false if --min-depth was given but no iteration reached it.
+bool trySokoban(int seed, int numThreads, const LevelParams& params) {
+  runStart = chrono::steady_clock::now();
+  vector<unique_ptr<WorkerArena>> arenas;
+  vector<WorkerStats> stats(numThreads);
+  if (numThreads == 1) {
+    arenas.emplace_back(new WorkerArena(params.numNodes));
+    WorkerArena& arena = *arenas[0];
+    arena.random.init(seed);
+    Stats::current = Stats();
+    // Split searches share one set of threads across iterations, rather than each starting its own.
+    unique_ptr<TaskScheduler> searchScheduler;
+    if (numSearchThreads > 1)
+      searchScheduler.reset(new TaskScheduler(numSearchThreads));
+    for (int iteration : Range(params.numIterations)) {
+      if (isRunOver())
+        break;
+      // When every level is kept, each iteration is seeded on its own, so any record can be regenerated
+      // alone with --batch -t 1 and its seed, whichever thread produced it.
+      if (keepAllLevels())
+        arena.random.init(seed + iteration);
+      runIteration(arena, seed, iteration, true, params, searchScheduler.get());
+    }
+    stats[0].counters = Stats::current;
+    if (searchScheduler) {
+      searchScheduler->join();
+      for (auto& workerStats : searchScheduler->getWorkerStats()) {
+        stats[0].counters.add(workerStats.counters);
+        stats[0].numTasks += workerStats.numTasks;
+        stats[0].numSteals += workerStats.numSteals;
+        stats[0].idleSeconds += workerStats.idleNanos * 1e-9;
+      }
+    }
+    arena.getTableStats(stats[0]);
+  } else {
+    // Every iteration is a task seeded on its own, so the result doesn't depend on which worker runs it.
+    // Workers that run out of iterations steal them, and the subtrees of split searches, from the others.
+    TaskScheduler scheduler(numThreads);
+    for (int i : Range(numThreads))
+      arenas.emplace_back(new WorkerArena(params.numNodes));
+    TaskGroup iterations;
+    for (int iteration : Range(params.numIterations))
+      scheduler.spawn([&, iteration] {
+        if (isRunOver())
+          return;
+        WorkerArena& arena = *arenas[TaskScheduler::getWorkerIndex()];
+        arena.random.init(seed + iteration);
+        runIteration(arena, seed, iteration, false, params, &scheduler);
+      }, iterations, true);
+    scheduler.waitFor(iterations);
+    scheduler.join();
+    vector<TaskScheduler::WorkerStats> schedulerStats = scheduler.getWorkerStats();
+    for (int i : Range(numThreads)) {
+      stats[i].counters = schedulerStats[i].counters;
+      stats[i].numTasks = schedulerStats[i].numTasks;
+      stats[i].numSteals = schedulerStats[i].numSteals;
+      stats[i].idleSeconds = schedulerStats[i].idleNanos * 1e-9;
+      arenas[i]->getTableStats(stats[i]);
+      arenas[i]->batch.reset();
+    }
+    BestLevel* best = &arenas[0]->best;
+    for (auto& arena : arenas)
+      if (arena->best.depth > -1 && best->isBeatenBy(arena->best.score, arena->best.iteration))
+        best = &arena->best;
+    if (best->depth > -1)
+      printResult(best->depth, best->features, *best->level);
+  }
+  bool found = false;
+  for (auto& arena : arenas)
+    if (arena->best.depth > -1)
+      found = true;
+  if (!found && !keepAllLevels())
     cout << "Unable to generate a level with these parameters" << endl;
+  if (printStats)
+    printStatsSummary(stats);
+  if (minDepth > 0 && !minDepthReached) {
+    cerr << "Depth " << minDepth << " not reached" << endl;
+    return false;
+  }
+  return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -42,6 +335,24 @@ int main(int argc, char* argv[]) {
     ("d,doors", "Number of rooms that are attached via door", cxxopts::value<int>()->default_value("1"))
     ("b,boulders", "Number of boulders", cxxopts::value<int>())
     ("p,positions", "Number of positions analyzed in each search", cxxopts::value<int>()->default_value("500"))
+    ("threads", "Number of worker threads running iterations", cxxopts::value<int>()->default_value("1"))
+    ("search-threads", "Number of threads sharing each search, for single large levels", cxxopts::value<int>()->default_value("1"))
+    ("s,seed", "Random seed (with several threads, iteration i uses seed + i)", cxxopts::value<int>())
+    ("verify", "Solve every printed level and report its optimal number of pushes")
+    ("verify-nodes", "Node limit of the solver used by --verify", cxxopts::value<int>()->default_value("200000"))
+    ("batch", "Print every generated level as one JSON line, with the seed that reproduces it")
+    ("corpus", "Write every generated level to a binary corpus file", cxxopts::value<string>())
+    ("server", "Answer level requests on stdin from pools refilled by the worker threads")
+    ("pool-size", "Number of ready levels kept per parameter set by --server", cxxopts::value<int>()->default_value("8"))
+    ("weight-depth", "Weight of the number of pulls in the score that picks the best state", cxxopts::value<double>()->default_value("1"))
+    ("weight-box-lines", "Weight of the number of box lines in the score", cxxopts::value<double>()->default_value("0"))
+    ("weight-box-changes", "Weight of the number of box changes in the score", cxxopts::value<double>()->default_value("0"))
+    ("weight-boulders", "Weight of the number of distinct boulders moved in the score", cxxopts::value<double>()->default_value("0"))
+    ("weight-door-pulls", "Weight of the number of pulls through doors in the score", cxxopts::value<double>()->default_value("0"))
+    ("time-limit", "Stop after this many seconds and print the best level so far", cxxopts::value<double>())
+    ("iteration-time-limit", "Stop each search after this many seconds with its best state so far", cxxopts::value<double>())
+    ("min-depth", "Stop as soon as a level with at least this depth is generated", cxxopts::value<int>())
+    ("stats", "Print JSON counters per thread and per run to stderr (needs a build with STATS=true)")
       ;
   options.parse(argc, argv);
   if (!options.count("boulders") || options.count("help")) {
@@ -54,7 +365,61 @@ int main(int argc, char* argv[]) {
   int moves = options["positions"].as<int>();
   int rooms = options["rooms"].as<int>();
   int doors = options["doors"].as<int>();
-  RandomGen randomGen;
-  randomGen.init(time(0));
-  trySokoban(randomGen, levelSize, tries, boulders, moves, rooms, doors);
+  int threads = max(1, options["threads"].as<int>());
+  numSearchThreads = max(1, options["search-threads"].as<int>());
+  if (options.count("min-depth"))
+    minDepth = max(0, options["min-depth"].as<int>());
+  if (options.count("time-limit"))
+    timeLimit = options["time-limit"].as<double>();
+  if (options.count("iteration-time-limit"))
+    iterationTimeLimit = options["iteration-time-limit"].as<double>();
+  int seed = options.count("seed") ? options["seed"].as<int>() : time(0);
+  if (options.count("verify"))
+    verifyNodes = options["verify-nodes"].as<int>();
+  printStats = options.count("stats");
+  scoreWeights.depth = options["weight-depth"].as<double>();
+  scoreWeights.boxLines = options["weight-box-lines"].as<double>();
+  scoreWeights.boxChanges = options["weight-box-changes"].as<double>();
+  scoreWeights.bouldersTouched = options["weight-boulders"].as<double>();
+  scoreWeights.doorPulls = options["weight-door-pulls"].as<double>();
+  LevelParams params {levelSize, boulders, moves, rooms, doors, tries};
+  if (options.count("server")) {
+    string error = params.getError();
+    if (!error.empty()) {
+      cerr << error << endl;
+      return 1;
+    }
+    // The server's levels are plain best-depth searches on one thread each.
+    for (string option : {"search-threads", "min-depth", "verify", "batch", "corpus", "stats"})
+      if (options.count(option)) {
+        cerr << "--" << option << " can't be combined with --server" << endl;
+        return 1;
+      }
+    if (!scoreWeights.isDepthOnly()) {
+      cerr << "The --weight options can't be combined with --server" << endl;
+      return 1;
+    }
+    LevelServer(params, seed, threads, max(1, options["pool-size"].as<int>()), timeLimit, iterationTimeLimit)
+        .run(cin, cout);
+    return 0;
+  }
+  unique_ptr<BatchWriter> batch;
+  if (options.count("batch")) {
+    batch.reset(new BatchWriter(stdout));
+    batchWriter = batch.get();
+  }
+  CorpusWriter corpus;
+  if (options.count("corpus")) {
+    if (!corpus.open(options["corpus"].as<string>())) {
+      cerr << "Unable to write corpus " << options["corpus"].as<string>() << endl;
+      return 1;
+    }
+    corpusWriter = &corpus;
+  }
+  bool reached = trySokoban(seed, threads, params);
+  if (corpusWriter && !corpus.save()) {
+    cerr << "Unable to write corpus " << options["corpus"].as<string>() << endl;
+    return 1;
+  }
+  return reached ? 0 : 1;
 }
@@ -0,0 +1,301 @@
+#include "regions.h"
+#include "bfsearch.h"
+#include <limits>
+
+static const Vec2 directions[] = { Vec2(0, 1), Vec2(1, 0), Vec2(0, -1), Vec2(-1, 0) };
+
+// The eight cells around a cell in cyclic order, each 4-adjacent to the next. Even indices are the
+// orthogonal neighbors.
+static const Vec2 ring[] = { Vec2(0, -1), Vec2(1, -1), Vec2(1, 0), Vec2(1, 1), Vec2(0, 1), Vec2(-1, 1),
+    Vec2(-1, 0), Vec2(-1, -1) };
+
+template <class Geometry>
+RegionMap<Geometry>::RegionMap(Rectangle b) : bounds(b), geometry(b), labels(geometry.getNumIndices(), 0),
+    marks(geometry.getNumIndices(), 0) {
+  for (auto& queue : queues)
+    queue.resize(bounds.area());
+}
+
+// Starts a new generation of marks. Each generation owns the four values starting at markBase.
+template <class Geometry>
+void RegionMap<Geometry>::nextMarks() {
+  if (markBase > numeric_limits<int>::max() - 8) {
+    fill(marks.begin(), marks.end(), 0);
+    markBase = 1;
+  }
+  markBase += 4;
+}
+
+template <class Geometry>
+void RegionMap<Geometry>::load(const BitBoard& board, Rectangle area) {
+  fill(labels.begin(), labels.end(), 0);
+  sizes.assign(1, 0);
+  minCells.assign(1, Vec2());
+  changes.clear();
+  DistanceTable table(bounds);
+  for (Vec2 v : area)
+    if (board.isFree(v) && labelAt(v) == 0) {
+      BfSearch search(table, area, v, [&](Vec2 pos) { return board.isFree(pos);}, neighborhood4());
+      int label = sizes.size();
+      sizes.push_back(0);
+      minCells.push_back(v);
+      for (Vec2 pos : search.getAllReachable()) {
+        labelAt(pos) = label;
+        ++sizes[label];
+        minCells[label] = min(minCells[label], pos);
+      }
+    }
+}
+
+template <class Geometry>
+bool RegionMap<Geometry>::sameRegion(Vec2 v, Vec2 w) const {
+  return labelAt(v) != 0 && labelAt(v) == labelAt(w);
+}
+
+template <class Geometry>
+Vec2 RegionMap<Geometry>::getCanonicalCell(Vec2 v) const {
+  CHECK(labelAt(v) != 0);
+  return minCells[labelAt(v)];
+}
+
+template <class Geometry>
+int RegionMap<Geometry>::getCheckpoint() const {
+  return changes.size();
+}
+
+template <class Geometry>
+void RegionMap<Geometry>::rollback(int checkpoint) {
+  while (changes.size() > checkpoint) {
+    const Change& change = changes.back();
+    switch (change.kind) {
+      case Change::LABEL:
+        labelAt(change.pos) = change.value;
+        break;
+      case Change::SIZE:
+        sizes[change.label] = change.value;
+        break;
+      case Change::MIN_CELL:
+        minCells[change.label] = change.pos;
+        break;
+      case Change::NEW_LABEL:
+        sizes.pop_back();
+        minCells.pop_back();
+        break;
+    }
+    changes.pop_back();
+  }
+}
+
+template <class Geometry>
+void RegionMap<Geometry>::setLabel(Vec2 v, int label) {
+  changes.push_back(Change{Change::LABEL, v, 0, labelAt(v)});
+  labelAt(v) = label;
+}
+
+template <class Geometry>
+void RegionMap<Geometry>::setSize(int label, int size) {
+  changes.push_back(Change{Change::SIZE, Vec2(), label, sizes[label]});
+  sizes[label] = size;
+}
+
+template <class Geometry>
+void RegionMap<Geometry>::setMinCell(int label, Vec2 v) {
+  changes.push_back(Change{Change::MIN_CELL, minCells[label], label, 0});
+  minCells[label] = v;
+}
+
+template <class Geometry>
+int RegionMap<Geometry>::newLabel() {
+  changes.push_back(Change{Change::NEW_LABEL, Vec2(), 0, 0});
+  sizes.push_back(0);
+  minCells.push_back(Vec2());
+  return sizes.size() - 1;
+}
+
+// Recomputes the smallest cell of a region by walking all of it. Only needed when a region loses its
+// smallest cell, either because it was blocked or because it was split off.
+template <class Geometry>
+void RegionMap<Geometry>::updateMinCell(int label, Vec2 from) {
+  nextMarks();
+  auto& queue = queues[0];
+  int size = 0;
+  Vec2 minCell = from;
+  markAt(from) = markBase;
+  queue[size++] = from;
+  for (int popped = 0; popped < size; ++popped)
+    for (Vec2 dir : directions) {
+      Vec2 next = queue[popped] + dir;
+      if (labelAt(next) == label && markAt(next) != markBase) {
+        markAt(next) = markBase;
+        queue[size++] = next;
+        minCell = min(minCell, next);
+      }
+    }
+  setMinCell(label, minCell);
+}
+
+template <class Geometry>
+void RegionMap<Geometry>::unblock(Vec2 v) {
+  CHECK(labelAt(v) == 0);
+  int best = 0;
+  for (Vec2 dir : directions) {
+    int label = labelAt(v + dir);
+    if (label != 0 && (best == 0 || sizes[label] > sizes[best]))
+      best = label;
+  }
+  if (best == 0) {
+    best = newLabel();
+    setMinCell(best, v);
+  }
+  setLabel(v, best);
+  setSize(best, sizes[best] + 1);
+  if (v < minCells[best])
+    setMinCell(best, v);
+  for (Vec2 dir : directions) {
+    int label = labelAt(v + dir);
+    if (label != 0 && label != best)
+      relabel(v + dir, label, best);
+  }
+}
+
+template <class Geometry>
+void RegionMap<Geometry>::relabel(Vec2 from, int oldLabel, int newLabel) {
+  auto& queue = queues[0];
+  int size = 0;
+  setLabel(from, newLabel);
+  queue[size++] = from;
+  for (int popped = 0; popped < size; ++popped)
+    for (Vec2 dir : directions) {
+      Vec2 next = queue[popped] + dir;
+      if (labelAt(next) == oldLabel) {
+        setLabel(next, newLabel);
+        queue[size++] = next;
+      }
+    }
+  setSize(newLabel, sizes[newLabel] + size);
+  setSize(oldLabel, sizes[oldLabel] - size);
+  if (minCells[oldLabel] < minCells[newLabel])
+    setMinCell(newLabel, minCells[oldLabel]);
+}
+
+template <class Geometry>
+void RegionMap<Geometry>::block(Vec2 v) {
+  int label = labelAt(v);
+  CHECK(label != 0);
+  setLabel(v, 0);
+  setSize(label, sizes[label] - 1);
+  // Orthogonal neighbors that lie on the same free arc of the surrounding ring are connected through
+  // it, so a split is only possible if they fall on different arcs.
+  int firstBlocked = -1;
+  for (int i : Range(8))
+    if (labelAt(v + ring[i]) == 0) {
+      firstBlocked = i;
+      break;
+    }
+  if (firstBlocked == -1) {
+    if (minCells[label] == v)
+      updateMinCell(label, v + ring[0]);
+    return;
+  }
+  Vec2 seeds[4];
+  int numSeeds = 0;
+  bool inArc = false;
+  bool arcSeeded = false;
+  for (int j : Range(1, 9)) {
+    int i = (firstBlocked + j) % 8;
+    bool free = labelAt(v + ring[i]) != 0;
+    if (free && !inArc)
+      arcSeeded = false;
+    inArc = free;
+    if (free && i % 2 == 0 && !arcSeeded) {
+      seeds[numSeeds++] = v + ring[i];
+      arcSeeded = true;
+    }
+  }
+  if (numSeeds > 1)
+    separate(seeds, numSeeds, label);
+  else if (numSeeds == 1 && minCells[label] == v)
+    updateMinCell(label, seeds[0]);
+}
+
+// Runs one search per seed in lockstep. Searches that touch each other are in the same component.
+// A group of searches that runs out of cells before meeting the others is a component of its own and
+// gets a new label. The last remaining group keeps the old label, and is never fully explored.
+template <class Geometry>
+void RegionMap<Geometry>::separate(const Vec2* seeds, int numSeeds, int label) {
+  nextMarks();
+  int group[4], head[4], tail[4];
+  bool exhausted[4];
+  for (int i : Range(numSeeds)) {
+    group[i] = i;
+    head[i] = 0;
+    tail[i] = 0;
+    exhausted[i] = false;
+    queues[i][tail[i]++] = seeds[i];
+    markAt(seeds[i]) = markBase + i;
+  }
+  auto find = [&](int i) {
+    while (group[i] != i)
+      i = group[i];
+    return i;
+  };
+  int numActive = numSeeds;
+  while (numActive > 1)
+    for (int i : Range(numSeeds)) {
+      int root = find(i);
+      if (exhausted[root] || numActive == 1)
+        continue;
+      if (head[i] == tail[i]) {
+        bool groupDone = true;
+        for (int j : Range(numSeeds))
+          if (find(j) == root && head[j] < tail[j])
+            groupDone = false;
+        if (groupDone) {
+          exhausted[root] = true;
+          --numActive;
+          int newL = newLabel();
+          int size = 0;
+          Vec2 minCell = queues[i][0];
+          for (int j : Range(numSeeds))
+            if (find(j) == root)
+              for (int k : Range(tail[j])) {
+                setLabel(queues[j][k], newL);
+                minCell = min(minCell, queues[j][k]);
+                ++size;
+              }
+          setSize(newL, size);
+          setMinCell(newL, minCell);
+          setSize(label, sizes[label] - size);
+        }
+        continue;
+      }
+      Vec2 pos = queues[i][head[i]++];
+      for (Vec2 dir : directions) {
+        Vec2 next = pos + dir;
+        if (labelAt(next) != label)
+          continue;
+        int mark = markAt(next) - markBase;
+        if (mark >= 0 && mark < numSeeds) {
+          int otherRoot = find(mark);
+          if (otherRoot != root) {
+            group[otherRoot] = root;
+            --numActive;
+          }
+        } else {
+          markAt(next) = markBase + i;
+          queues[i][tail[i]++] = next;
+        }
+      }
+    }
+  for (int i : Range(numSeeds))
+    if (!exhausted[find(i)]) {
+      if (labelAt(minCells[label]) != label)
+        updateMinCell(label, seeds[i]);
+      break;
+    }
+}
+
+template class RegionMap<DynamicGeometry>;
+template class RegionMap<FixedGeometry<28, 16>>;
+template class RegionMap<FixedGeometry<40, 24>>;
+template class RegionMap<FixedGeometry<64, 32>>;
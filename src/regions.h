@@ -0,0 +1,55 @@
+#pragma once
+
+#include "util.h"
+#include "bitboard.h"
+#include "geometry.h"
+
+// Labels the connected components of the free cells, so two cells are mutually reachable iff they
+// carry the same nonzero label. Blocking or freeing a single cell repairs the labels around it
+// instead of relabeling the whole level, and every change is logged so it can be rolled back.
+// The Geometry maps cells to array indices. It is instantiated in regions.cpp for DynamicGeometry and
+// for the FixedGeometry sizes that SokobanMaker specializes its search for.
+template <class Geometry = DynamicGeometry>
+class RegionMap {
+  public:
+  RegionMap(Rectangle bounds);
+
+  void load(const BitBoard&, Rectangle area);
+  bool sameRegion(Vec2, Vec2) const;
+  // The smallest cell (in Vec2 order) of the region containing the given free cell. It identifies the
+  // region independently of how the labels were assigned.
+  Vec2 getCanonicalCell(Vec2) const;
+  void block(Vec2);
+  void unblock(Vec2);
+
+  int getCheckpoint() const;
+  void rollback(int checkpoint);
+
+  private:
+  struct Change {
+    enum Kind { LABEL, SIZE, MIN_CELL, NEW_LABEL } kind;
+    Vec2 pos;
+    int label;
+    int value;
+  };
+  void setLabel(Vec2, int label);
+  void setSize(int label, int size);
+  void setMinCell(int label, Vec2);
+  void updateMinCell(int label, Vec2 from);
+  int newLabel();
+  void relabel(Vec2 from, int oldLabel, int newLabel);
+  void separate(const Vec2* seeds, int numSeeds, int label);
+  void nextMarks();
+  int& labelAt(Vec2 v) { return labels[geometry.getIndex(v)]; }
+  int labelAt(Vec2 v) const { return labels[geometry.getIndex(v)]; }
+  int& markAt(Vec2 v) { return marks[geometry.getIndex(v)]; }
+  Rectangle bounds;
+  Geometry geometry;
+  vector<int> labels;
+  vector<int> sizes;
+  vector<Vec2> minCells;
+  vector<Change> changes;
+  vector<int> marks;
+  int markBase = 1;
+  vector<Vec2> queues[4];
+};
@@ -0,0 +1,150 @@
+#include "scheduler.h"
+
+thread_local int TaskScheduler::workerIndex = -1;
+thread_local TaskScheduler* TaskScheduler::workerScheduler = nullptr;
+
+TaskScheduler::TaskScheduler(int numWorkers) : numQueued(0), numQueuedNonBlocking(0), nextDeque(0),
+    stopping(false) {
+  CHECK(numWorkers >= 1);
+  for (int i : Range(numWorkers))
+    workers.emplace_back(new Worker());
+  for (int i : Range(numWorkers))
+    threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+}
+
+TaskScheduler::~TaskScheduler() {
+  join();
+}
+
+void TaskScheduler::join() {
+  {
+    lock_guard<mutex> lock(idleMutex);
+    stopping = true;
+  }
+  taskAdded.notify_all();
+  for (auto& t : threads)
+    t.join();
+  threads.clear();
+}
+
+int TaskScheduler::getNumWorkers() const {
+  return workers.size();
+}
+
+int TaskScheduler::getWorkerIndex() {
+  return workerIndex;
+}
+
+vector<TaskScheduler::WorkerStats> TaskScheduler::getWorkerStats() {
+  vector<WorkerStats> ret;
+  for (auto& worker : workers)
+    ret.push_back(worker->stats);
+  return ret;
+}
+
+void TaskScheduler::spawn(function<void()> task, TaskGroup& group, bool mayBlock) {
+  int index = workerScheduler == this ? workerIndex : nextDeque++ % workers.size();
+  ++group.numPending;
+  {
+    lock_guard<mutex> lock(workers[index]->dequeMutex);
+    (mayBlock ? workers[index]->blockingTasks : workers[index]->tasks)
+        .push_back(Task{std::move(task), &group, mayBlock});
+  }
+  {
+    lock_guard<mutex> lock(idleMutex);
+    ++numQueued;
+    if (!mayBlock)
+      ++numQueuedNonBlocking;
+  }
+  // Waiting helpers can only run non-blocking tasks, so waking a single thread could pick the wrong one.
+  taskAdded.notify_all();
+}
+
+// The newest task, preferring non-blocking ones, so a worker finishes the subtrees of its own search
+// before it starts another iteration.
+bool TaskScheduler::popOwn(int index, bool allowBlocking, Task& task) {
+  Worker& worker = *workers[index];
+  lock_guard<mutex> lock(worker.dequeMutex);
+  deque<Task>& tasks = !worker.tasks.empty() || !allowBlocking ? worker.tasks : worker.blockingTasks;
+  if (tasks.empty())
+    return false;
+  task = std::move(tasks.back());
+  tasks.pop_back();
+  return true;
+}
+
+// Tries the other workers in turn, starting after the thief, and takes the oldest task of a victim.
+bool TaskScheduler::steal(int index, bool allowBlocking, Task& task) {
+  for (int i : Range(1, workers.size())) {
+    Worker& victim = *workers[(index + i) % workers.size()];
+    lock_guard<mutex> lock(victim.dequeMutex);
+    deque<Task>& tasks = !victim.tasks.empty() || !allowBlocking ? victim.tasks : victim.blockingTasks;
+    if (!tasks.empty()) {
+      task = std::move(tasks.front());
+      tasks.pop_front();
+      ++workers[index]->stats.numSteals;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskScheduler::execute(Task& task) {
+  --numQueued;
+  if (!task.mayBlock)
+    --numQueuedNonBlocking;
+  ++workers[workerIndex]->stats.numTasks;
+  task.run();
+  if (--task.group->numPending == 0) {
+    // Taking the lock orders the notify after a waiter's check of numPending.
+    { lock_guard<mutex> lock(idleMutex); }
+    taskAdded.notify_all();
+  }
+}
+
+void TaskScheduler::workerLoop(int index) {
+  workerIndex = index;
+  workerScheduler = this;
+  Stats::current = Stats();
+  WorkerStats& stats = workers[index]->stats;
+  while (true) {
+    Task task;
+    if (popOwn(index, true, task) || steal(index, true, task)) {
+      execute(task);
+      continue;
+    }
+    if (stopping && numQueued == 0)
+      break;
+    long long idleStart = Stats::getNanos();
+    {
+      unique_lock<mutex> lock(idleMutex);
+      if (numQueued == 0 && !stopping)
+        taskAdded.wait(lock);
+    }
+    stats.idleNanos += Stats::getNanos() - idleStart;
+  }
+  stats.counters = Stats::current;
+}
+
+void TaskScheduler::waitFor(TaskGroup& group) {
+  if (workerScheduler != this) {
+    unique_lock<mutex> lock(idleMutex);
+    taskAdded.wait(lock, [&] { return group.numPending == 0; });
+    return;
+  }
+  WorkerStats& stats = workers[workerIndex]->stats;
+  while (group.numPending > 0) {
+    Task task;
+    if (popOwn(workerIndex, false, task) || steal(workerIndex, false, task)) {
+      execute(task);
+      continue;
+    }
+    long long idleStart = Stats::getNanos();
+    {
+      unique_lock<mutex> lock(idleMutex);
+      if (group.numPending > 0 && numQueuedNonBlocking == 0)
+        taskAdded.wait(lock);
+    }
+    stats.idleNanos += Stats::getNanos() - idleStart;
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "util.h"
+#include "stats.h"
+
+// Tasks spawned together, which can be waited for as a whole.
+struct TaskGroup {
+  atomic<int> numPending;
+  TaskGroup() : numPending(0) {}
+};
+
+// Runs tasks on a fixed set of threads, each with its own deque. A worker runs the newest task of its
+// own deque, and when that is empty, steals the oldest task of another worker, so uneven tasks even out
+// without a central queue.
+//
+// Tasks that may block, because they wait for a group of their own, are only started from a worker's
+// main loop. A worker waiting for a group helps by running only non-blocking tasks, so waits never nest.
+// Each worker keeps the two kinds in separate deques, so neither a pop nor a steal scans past the tasks
+// it can't run, and a worker with nothing it can run sleeps until a task is spawned or its group ends.
+class TaskScheduler {
+  public:
+  TaskScheduler(int numWorkers);
+  ~TaskScheduler();
+
+  // Waits for all tasks to finish and stops the workers. No tasks can be spawned afterwards.
+  void join();
+
+  int getNumWorkers() const;
+  // Called from a worker, pushes onto its own deque. Called from any other thread, the deques are
+  // filled in turn.
+  void spawn(function<void()> task, TaskGroup&, bool mayBlock);
+  // Returns once every task of the group has finished. A worker runs non-blocking tasks meanwhile.
+  void waitFor(TaskGroup&);
+
+  // Index of the worker of the calling thread, or -1 if it isn't a worker of any scheduler.
+  static int getWorkerIndex();
+
+  struct WorkerStats {
+    long long numTasks = 0;
+    long long numSteals = 0;
+    long long idleNanos = 0;
+    // Stats::current of the worker thread when it exited, only set after join().
+    Stats counters = Stats();
+  };
+  // Meant to be read after join().
+  vector<WorkerStats> getWorkerStats();
+
+  private:
+  struct Task {
+    function<void()> run;
+    TaskGroup* group;
+    bool mayBlock;
+  };
+  struct Worker {
+    mutex dequeMutex;
+    deque<Task> tasks;
+    deque<Task> blockingTasks;
+    WorkerStats stats;
+  };
+  void workerLoop(int index);
+  bool popOwn(int index, bool allowBlocking, Task&);
+  bool steal(int index, bool allowBlocking, Task&);
+  void execute(Task&);
+  vector<unique_ptr<Worker>> workers;
+  vector<thread> threads;
+  // Changed under idleMutex as well, so a worker that finds them zero under it can't miss the notify.
+  atomic<int> numQueued;
+  atomic<int> numQueuedNonBlocking;
+  atomic<int> nextDeque;
+  atomic<bool> stopping;
+  mutex idleMutex;
+  condition_variable taskAdded;
+  static thread_local int workerIndex;
+  static thread_local TaskScheduler* workerScheduler;
+};
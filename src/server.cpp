@@ -0,0 +1,277 @@
+#include <sstream>
+#include <tuple>
+#include "server.h"
+#include "sokoban.h"
+#include "batch.h"
+
+bool LevelParams::operator < (const LevelParams& o) const {
+  return make_tuple(size.x, size.y, numBoulders, numNodes, numRooms, numDoors, numIterations)
+      < make_tuple(o.size.x, o.size.y, o.numBoulders, o.numNodes, o.numRooms, o.numDoors, o.numIterations);
+}
+
+string LevelParams::getError() const {
+  // Smaller layouts don't leave room for the boulder rooms and trip the generator's checks.
+  if (size.x < 20 || size.y < 12 || size.x > 1000 || size.y > 1000)
+    return "level size must be between 20x12 and 1000x1000";
+  if (numBoulders < 1 || numBoulders > size.x - 16)
+    return "number of boulders must be between 1 and width - 16";
+  if (numNodes < 1 || numRooms < 1 || numDoors < 0 || numIterations < 1)
+    return "positions, rooms and iterations must be positive";
+  if (numNodes > maxNodes || numIterations > maxIterations)
+    return "at most " + to_string(maxNodes) + " positions and " + to_string(maxIterations) + " iterations";
+  return "";
+}
+
+static chrono::steady_clock::duration toDuration(double seconds) {
+  return chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+}
+
+bool generateLevel(int seed, const LevelParams& params, TranspositionTable& visited, int& depth,
+    Table<char>& level, double timeLimit, double iterationTimeLimit) {
+  RandomGen random;
+  random.init(seed);
+  depth = -1;
+  auto start = chrono::steady_clock::now();
+  auto deadline = chrono::steady_clock::time_point::max();
+  if (timeLimit > 0)
+    deadline = start + toDuration(timeLimit);
+  for (int i : Range(params.numIterations)) {
+    auto now = i == 0 ? start : chrono::steady_clock::now();
+    if (now >= deadline)
+      break;
+    SokobanMaker sokoban(random, params.size, params.numBoulders, params.numNodes);
+    sokoban.setNumRooms(params.numRooms);
+    sokoban.setNumDoors(params.numDoors);
+    sokoban.setVisitedTable(visited);
+    if (iterationTimeLimit > 0)
+      sokoban.setDeadline(min(deadline, now + toDuration(iterationTimeLimit)));
+    else if (timeLimit > 0)
+      sokoban.setDeadline(deadline);
+    if (sokoban.make() && sokoban.getMaxDepth() > depth) {
+      depth = sokoban.getMaxDepth();
+      level = sokoban.getResult();
+    }
+  }
+  return depth > -1;
+}
+
+constexpr chrono::seconds LevelServer::poolIdleTime;
+
+LevelServer::LevelServer(const LevelParams& d, int seed, int numWorkers, int size, double time,
+    double iterationTime)
+    : defaults(d), poolSize(size), timeLimit(time), iterationTimeLimit(iterationTime), nextSeed(seed), coldVisited(d.numNodes) {
+  pools[defaults].lastRequest = chrono::steady_clock::now();
+  for (int i : Range(numWorkers))
+    workers.emplace_back(&LevelServer::workerLoop, this);
+}
+
+LevelServer::~LevelServer() {
+  {
+    lock_guard<mutex> lock(poolMutex);
+    stopping = true;
+  }
+  poolChanged.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void LevelServer::run(istream& in, ostream& out) {
+  string line;
+  while (getline(in, line)) {
+    if (line == "quit")
+      break;
+    if (line.empty())
+      continue;
+    out << handleRequest(line) << '\n' << flush;
+  }
+}
+
+static string getErrorRecord(const string& error) {
+  return "{\"error\":\"" + error + "\"}";
+}
+
+string LevelServer::handleRequest(const string& line) {
+  istringstream input(line);
+  string command;
+  input >> command;
+  if (command == "status")
+    return getStatus();
+  if (command != "get")
+    return getErrorRecord("unknown command " + command);
+  LevelParams params = defaults;
+  string arg;
+  while (input >> arg) {
+    int value;
+    istringstream valueInput(arg.substr(min(arg.size(), size_t(2))));
+    if (arg.size() < 3 || arg[1] != '=' || !(valueInput >> value) || !valueInput.eof())
+      return getErrorRecord("malformed argument " + arg);
+    switch (arg[0]) {
+      case 'x': params.size.x = value; break;
+      case 'y': params.size.y = value; break;
+      case 'b': params.numBoulders = value; break;
+      case 'p': params.numNodes = value; break;
+      case 'r': params.numRooms = value; break;
+      case 'd': params.numDoors = value; break;
+      case 't': params.numIterations = value; break;
+      default: return getErrorRecord("unknown parameter " + arg);
+    }
+  }
+  string error = params.getError();
+  if (!error.empty())
+    return getErrorRecord(error);
+  return handleGet(params);
+}
+
+string LevelServer::handleGet(const LevelParams& params) {
+  string ret;
+  {
+    lock_guard<mutex> lock(poolMutex);
+    auto now = chrono::steady_clock::now();
+    evictIdlePools(now);
+    auto it = pools.find(params);
+    if (it == pools.end())
+      it = addPool(params, now);
+    if (it == pools.end())
+      return getErrorRecord("too many parameter sets in use");
+    Pool& pool = it->second;
+    pool.lastRequest = now;
+    if (pool.numFailures >= maxFailures)
+      return getErrorRecord("unable to generate a level with these parameters");
+    if (!pool.levels.empty()) {
+      ++pool.numHits;
+      ret = "{\"source\":\"pool\",\"level\":";
+      PooledLevel& pooled = pool.levels.front();
+      appendLevelRecord(ret, pooled.seed, pooled.depth, pooled.level);
+      pool.levels.pop_front();
+    } else
+      ++pool.numMisses;
+  }
+  // Either a level was taken or a new pool was created, so the workers have something to refill.
+  poolChanged.notify_all();
+  if (!ret.empty())
+    return ret + "}";
+  int seed = nextSeed++;
+  int depth;
+  Table<char> level(params.size);
+  bool found = generateLevel(seed, params, coldVisited, depth, level, timeLimit, iterationTimeLimit);
+  {
+    lock_guard<mutex> lock(poolMutex);
+    auto it = pools.find(params);
+    if (it != pools.end())
+      recordResult(it->second, found, chrono::steady_clock::now());
+  }
+  if (!found)
+    return getErrorRecord("unable to generate a level with these parameters");
+  ret = "{\"source\":\"cold\",\"level\":";
+  appendLevelRecord(ret, seed, depth, level);
+  return ret + "}";
+}
+
+map<LevelParams, LevelServer::Pool>::iterator LevelServer::addPool(const LevelParams& params,
+    chrono::steady_clock::time_point now) {
+  if (int(pools.size()) >= maxPools) {
+    auto oldest = pools.end();
+    for (auto it = pools.begin(); it != pools.end(); ++it)
+      if (canEvict(it) && (oldest == pools.end() || it->second.lastRequest < oldest->second.lastRequest))
+        oldest = it;
+    if (oldest == pools.end())
+      return pools.end();
+    pools.erase(oldest);
+  }
+  auto it = pools.emplace(params, Pool()).first;
+  it->second.lastRequest = now;
+  return it;
+}
+
+void LevelServer::evictIdlePools(chrono::steady_clock::time_point now) {
+  for (auto it = pools.begin(); it != pools.end();)
+    if (canEvict(it) && now - it->second.lastRequest > poolIdleTime)
+      it = pools.erase(it);
+    else
+      ++it;
+}
+
+bool LevelServer::canEvict(map<LevelParams, Pool>::iterator it) const {
+  return it->second.numPending == 0 && (it->first < defaults || defaults < it->first);
+}
+
+void LevelServer::recordResult(Pool& pool, bool found, chrono::steady_clock::time_point now) {
+  if (found) {
+    pool.numFailures = 0;
+    return;
+  }
+  ++pool.numFailures;
+  pool.retryTime = now + chrono::milliseconds(100) * (1 << min(pool.numFailures, 10));
+}
+
+string LevelServer::getStatus() {
+  lock_guard<mutex> lock(poolMutex);
+  string ret = "{\"pools\":[";
+  for (auto& elem : pools) {
+    const LevelParams& params = elem.first;
+    const Pool& pool = elem.second;
+    if (ret.back() != '[')
+      ret += ',';
+    ret += "{\"x\":" + to_string(params.size.x) + ",\"y\":" + to_string(params.size.y)
+        + ",\"b\":" + to_string(params.numBoulders) + ",\"r\":" + to_string(params.numRooms)
+        + ",\"d\":" + to_string(params.numDoors) + ",\"p\":" + to_string(params.numNodes)
+        + ",\"t\":" + to_string(params.numIterations) + ",\"ready\":" + to_string(pool.levels.size())
+        + ",\"pending\":" + to_string(pool.numPending) + ",\"hits\":" + to_string(pool.numHits)
+        + ",\"misses\":" + to_string(pool.numMisses) + ",\"failures\":" + to_string(pool.numFailures)
+        + "}";
+  }
+  return ret + "]}";
+}
+
+map<LevelParams, LevelServer::Pool>::iterator LevelServer::choosePoolToFill(
+    chrono::steady_clock::time_point now, chrono::steady_clock::time_point& nextRetry) {
+  auto best = pools.end();
+  int bestFill = poolSize;
+  nextRetry = chrono::steady_clock::time_point::max();
+  for (auto it = pools.begin(); it != pools.end(); ++it) {
+    const Pool& pool = it->second;
+    int fill = pool.levels.size() + pool.numPending;
+    if (fill >= bestFill || pool.numFailures >= maxFailures)
+      continue;
+    if (pool.numFailures > 0 && pool.retryTime > now) {
+      nextRetry = min(nextRetry, pool.retryTime);
+      continue;
+    }
+    best = it;
+    bestFill = fill;
+  }
+  return best;
+}
+
+void LevelServer::workerLoop() {
+  TranspositionTable visited(defaults.numNodes);
+  Table<char> level(defaults.size);
+  unique_lock<mutex> lock(poolMutex);
+  while (true) {
+    auto pool = pools.end();
+    while (!stopping) {
+      chrono::steady_clock::time_point nextRetry;
+      pool = choosePoolToFill(chrono::steady_clock::now(), nextRetry);
+      if (pool != pools.end())
+        break;
+      if (nextRetry == chrono::steady_clock::time_point::max())
+        poolChanged.wait(lock);
+      else
+        poolChanged.wait_until(lock, nextRetry);
+    }
+    if (stopping)
+      return;
+    ++pool->second.numPending;
+    LevelParams params = pool->first;
+    int seed = nextSeed++;
+    lock.unlock();
+    int depth;
+    bool found = generateLevel(seed, params, visited, depth, level, timeLimit, iterationTimeLimit);
+    lock.lock();
+    // The pending generation kept the pool from being evicted.
+    --pool->second.numPending;
+    recordResult(pool->second, found, chrono::steady_clock::now());
+    if (found)
+      pool->second.levels.push_back(PooledLevel{seed, depth, level});
+  }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "util.h"
+#include "transposition.h"
+
+struct LevelParams {
+  Vec2 size;
+  int numBoulders;
+  int numNodes;
+  int numRooms;
+  int numDoors;
+  int numIterations;
+
+  // Bounds on the work one request can ask for.
+  static const int maxNodes = 2000000;
+  static const int maxIterations = 1000;
+
+  bool operator < (const LevelParams&) const;
+  // Returns an empty string if the generator can handle the parameters.
+  string getError() const;
+};
+
+// Returns the best of params.numIterations levels, the same one a single-threaded run with this seed
+// prints last. Returns false if no iteration succeeded.
+//
+// Positive time limits, in seconds, bound the whole call and each iteration like --time-limit and
+// --iteration-time-limit. The level returned then depends on how fast the machine is.
+bool generateLevel(int seed, const LevelParams&, TranspositionTable& visited, int& depth, Table<char>& level,
+    double timeLimit = 0, double iterationTimeLimit = 0);
+
+// Answers a line protocol with generated levels. Each distinct parameter set gets a pool of ready
+// levels, which worker threads keep topped up. A request is served from the pool if possible, and
+// only generates a level on the spot when its pool is empty.
+//
+//   get [x=W] [y=H] [b=BOULDERS] [r=ROOMS] [d=DOORS] [p=POSITIONS] [t=ITERATIONS]
+//       -> {"source":"pool"|"cold","level":{...}}, with the level in --batch format
+//   status -> {"pools":[...]}
+//   quit
+//
+// Omitted parameters take the values given on the command line. Errors are answered with
+// {"error":"..."}. The time limits apply to each generated level, both in the pools and on the spot.
+//
+// At most maxPools pools exist. A new parameter set evicts the least recently requested pool when
+// they're all taken, and pools that go unrequested for poolIdleTime are dropped; the pool of the
+// command line parameters is always kept. A pool whose levels keep failing to generate is retried
+// with exponential backoff, and given up on after maxFailures failures in a row.
+class LevelServer {
+  public:
+  LevelServer(const LevelParams& defaults, int seed, int numWorkers, int poolSize, double timeLimit = 0,
+      double iterationTimeLimit = 0);
+  ~LevelServer();
+
+  // Serves requests until quit or the end of input.
+  void run(istream& in, ostream& out);
+
+  private:
+  struct PooledLevel {
+    int seed;
+    int depth;
+    Table<char> level;
+  };
+  struct Pool {
+    deque<PooledLevel> levels;
+    int numPending = 0;
+    long long numHits = 0;
+    long long numMisses = 0;
+    chrono::steady_clock::time_point lastRequest;
+    // Consecutive failed generations, and when the workers may try again.
+    int numFailures = 0;
+    chrono::steady_clock::time_point retryTime;
+  };
+  static const int maxPools = 64;
+  static constexpr chrono::seconds poolIdleTime = chrono::seconds(600);
+  static const int maxFailures = 8;
+  string handleRequest(const string& line);
+  string handleGet(const LevelParams&);
+  string getStatus();
+  void workerLoop();
+  // Returns the pool that is furthest from full, or end() if all of them are full, given up on or
+  // backing off. In the last case, nextRetry is set to the earliest time one can be filled again.
+  map<LevelParams, Pool>::iterator choosePoolToFill(chrono::steady_clock::time_point now,
+      chrono::steady_clock::time_point& nextRetry);
+  // Returns end() if all pools are taken and none can be evicted.
+  map<LevelParams, Pool>::iterator addPool(const LevelParams&, chrono::steady_clock::time_point now);
+  void evictIdlePools(chrono::steady_clock::time_point now);
+  // Pools with a generation in progress are referenced by a worker, so they're never evicted.
+  bool canEvict(map<LevelParams, Pool>::iterator) const;
+  void recordResult(Pool&, bool found, chrono::steady_clock::time_point now);
+  LevelParams defaults;
+  int poolSize;
+  double timeLimit;
+  double iterationTimeLimit;
+  atomic<int> nextSeed;
+  map<LevelParams, Pool> pools;
+  mutex poolMutex;
+  condition_variable poolChanged;
+  bool stopping = false;
+  vector<thread> workers;
+  TranspositionTable coldVisited;
+};
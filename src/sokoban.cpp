@@ -1,12 +1,16 @@
 #include "util.h"
 #include "sokoban.h"
 #include "bfsearch.h"
+#include "stats.h"
 #include <iostream>
+#include <limits>
 
 using namespace std;
 
 
 void SokobanMaker::prepareBoulderRooms(Rectangle area, Range mainWidth, Range otherWidth) {
+  STAT_TIMER(roomsNanos);
+  doors.clear();
   Vec2 mainSize(random.get(mainWidth), random.get(mainWidth));
   Vec2 mainPos((area.width() - mainSize.x) / 2, (area.height() - mainSize.y) / 2);
   Rectangle mainRect(mainPos, mainPos + mainSize);
@@ -30,7 +34,8 @@ void SokobanMaker::prepareBoulderRooms(Rectangle area, Range mainWidth, Range ot
                      min(area.bottom(), mainRect.bottom())));
         if (door) {
           pos += Vec2(1, 0);
-          level[Vec2(mainRect.right(), random.get(max(mainRect.top(), pos.y), min(mainRect.bottom(), pos.y + size.y)))] = '.';
+          doors.push_back(Vec2(mainRect.right(), random.get(max(mainRect.top(), pos.y), min(mainRect.bottom(), pos.y + size.y))));
+          level[doors.back()] = '.';
         }
         break;
       case 1:
@@ -39,7 +44,8 @@ void SokobanMaker::prepareBoulderRooms(Rectangle area, Range mainWidth, Range ot
                      min(area.right(), mainRect.right())), mainRect.bottom());
         if (door) {
           pos += Vec2(0, 1);
-          level[Vec2(random.get(max(mainRect.left(), pos.x), min(mainRect.right(), pos.x + size.x)), mainRect.bottom())] = '.';
+          doors.push_back(Vec2(random.get(max(mainRect.left(), pos.x), min(mainRect.right(), pos.x + size.x)), mainRect.bottom()));
+          level[doors.back()] = '.';
         }
         break;
       case 2:
@@ -48,7 +54,8 @@ void SokobanMaker::prepareBoulderRooms(Rectangle area, Range mainWidth, Range ot
                      min(area.bottom(), mainRect.bottom())));
         if (door) {
           pos += Vec2(-1, 0);
-          level[Vec2(mainRect.left() - 1, random.get(max(mainRect.top(), pos.y), min(mainRect.bottom(), pos.y + size.y)))] = '.';
+          doors.push_back(Vec2(mainRect.left() - 1, random.get(max(mainRect.top(), pos.y), min(mainRect.bottom(), pos.y + size.y))));
+          level[doors.back()] = '.';
         }
         break;
       case 3:
@@ -57,7 +64,8 @@ void SokobanMaker::prepareBoulderRooms(Rectangle area, Range mainWidth, Range ot
                      min(area.right(), mainRect.right())), mainRect.top() - size.y);
         if (door) {
           pos += Vec2(0, -1);
-          level[Vec2(random.get(max(mainRect.left(), pos.x), min(mainRect.right(), pos.x + size.x)), mainRect.top() - 1)] = '.';
+          doors.push_back(Vec2(random.get(max(mainRect.left(), pos.x), min(mainRect.right(), pos.x + size.x)), mainRect.top() - 1));
+          level[doors.back()] = '.';
         }
         break;
     }
@@ -67,8 +75,7 @@ void SokobanMaker::prepareBoulderRooms(Rectangle area, Range mainWidth, Range ot
 }
 
 SokobanMaker::SokobanMaker(RandomGen& r, Vec2 levelSize, int boulders, int nodes)
-  : random(r), level(levelSize, '#'), bestLevel(levelSize, '?'), numNodes(nodes), numBoulders(boulders),
-    distanceTable(Rectangle(levelSize)) {
+  : random(r), level(levelSize, '#'), bestLevel(levelSize, '?'), bits(Rectangle(levelSize)), zobrist(Rectangle(levelSize)), numNodes(nodes), numBoulders(boulders) {
 }
 
 
@@ -82,6 +89,56 @@ SokobanMaker&SokobanMaker::setNumDoors(int d) {
   return *this;
 }
 
+SokobanMaker& SokobanMaker::setVisitedTable(TranspositionTable& t) {
+  visitedTable = &t;
+  return *this;
+}
+
+SokobanMaker& SokobanMaker::setVisitedTable(ConcurrentTranspositionTable& t) {
+  concurrentVisitedTable = &t;
+  return *this;
+}
+
+SokobanMaker& SokobanMaker::setScoreWeights(const ScoreWeights& w) {
+  weights = w;
+  return *this;
+}
+
+SokobanMaker& SokobanMaker::setNumSearchThreads(int n) {
+  numSearchThreads = n;
+  return *this;
+}
+
+SokobanMaker& SokobanMaker::setScheduler(TaskScheduler* s) {
+  scheduler = s;
+  return *this;
+}
+
+SokobanMaker& SokobanMaker::setDeadline(chrono::steady_clock::time_point d) {
+  hasDeadline = true;
+  deadline = d;
+  return *this;
+}
+
+SokobanMaker& SokobanMaker::setMinDepth(int d) {
+  minDepth = d;
+  return *this;
+}
+
+SokobanMaker& SokobanMaker::setStopFlag(const atomic<bool>* flag) {
+  stopFlag = flag;
+  return *this;
+}
+
+double ScoreWeights::getScore(const PathFeatures& f) const {
+  return depth * f.depth + boxLines * f.boxLines + boxChanges * f.boxChanges
+      + bouldersTouched * f.bouldersTouched + doorPulls * f.doorPulls;
+}
+
+bool ScoreWeights::isDepthOnly() const {
+  return depth == 1 && boxLines == 0 && boxChanges == 0 && bouldersTouched == 0 && doorPulls == 0;
+}
+
 static void printLevel(const Table<char>& level) {
   for (int y : level.getBounds().getYRange()) {
     for (int x : level.getBounds().getXRange())
@@ -91,6 +148,27 @@ static void printLevel(const Table<char>& level) {
 }
 
 bool SokobanMaker::make() {
+#ifdef SOKOBAN_STATS
+  long long start = Stats::getNanos();
+  bool ret = build();
+  long long time = Stats::getNanos() - start;
+  ++Stats::current.makeCalls;
+  Stats::current.makeNanos += time;
+  if (!ret) {
+    ++Stats::current.failedMakes;
+    Stats::current.failedMakeNanos += time;
+  }
+  return ret;
+#else
+  return build();
+#endif
+}
+
+// The deadline is also checked before the layout and before the search, so a make() started just before
+// it doesn't run over by a whole setup.
+bool SokobanMaker::build() {
+  if (shouldStop())
+    return false;
   Rectangle area(level.getBounds());
   for (Vec2 v : area)
     level[v] = '#';
@@ -112,20 +190,54 @@ bool SokobanMaker::make() {
     Vec2 pos = start + Vec2(i, 0);
     level[pos] = '0';
     boulders.push_back(pos);
+    boulderHash ^= zobrist.boulder(pos);
   }
   level[start + Vec2(numBoulders + 1, 0)] = '+';
   for (Vec2 v : Rectangle::centered(start + Vec2(numBoulders + prizeRoomRadius + 2, 0), prizeRoomRadius))
     level[v] = '.';
-  set<int> visited;
-  Vec2 curPos = start;
-  moveBoulder(0, curPos, visited);
+  bits.load(level, workArea);
+  if (numSearchThreads > 1) {
+    if (!concurrentVisitedTable) {
+      ownConcurrentVisitedTable.reset(new ConcurrentTranspositionTable(numNodes));
+      concurrentVisitedTable = ownConcurrentVisitedTable.get();
+    }
+    concurrentVisitedTable->clear();
+  } else {
+    if (!visitedTable) {
+      ownVisitedTable.reset(new TranspositionTable(numNodes));
+      visitedTable = ownVisitedTable.get();
+    }
+    visitedTable->clear();
+  }
+  if (shouldStop())
+    return false;
+  // The usual level sizes get a search with compile-time dimensions. Keep in sync with the
+  // instantiations at the bottom of regions.cpp.
+  Vec2 size = area.getSize();
+  long long searchStart = Stats::getNanos();
+  if (size == Vec2(28, 16))
+    search<FixedGeometry<28, 16>>(start);
+  else if (size == Vec2(40, 24))
+    search<FixedGeometry<40, 24>>(start);
+  else if (size == Vec2(64, 32))
+    search<FixedGeometry<64, 32>>(start);
+  else
+    search<DynamicGeometry>(start);
+  searchNanos = Stats::getNanos() - searchStart;
+  if (best.boulders.empty())
+    return false;
+  bestLevel = level;
+  for (Vec2 v : boulders)
+    bestLevel[v] = '.';
+  for (Vec2 v : best.boulders)
+    bestLevel[v] = '0';
   for (int i : Range(1, numBoulders + 1)) {
     Vec2 holePos = start + Vec2(i, 0);
-    if (holePos == finalPos || bestLevel[holePos] != '.')
+    if (holePos == best.playerPos || bestLevel[holePos] != '.')
       return false;
     bestLevel[holePos] = '^';
   }
-  bestLevel[finalPos] = '@';
+  bestLevel[best.playerPos] = '@';
   return true;
 }
 
@@ -134,60 +246,362 @@ Table<char> SokobanMaker::getResult() {
 }
 
 int SokobanMaker::getMaxDepth() {
-  return maxDepth;
+  return best.depth;
 }
 
-int SokobanMaker::getHash(const vector<Vec2>& boulders, Vec2 curPos) {
-  int seed = 0;
-  for (auto& i : boulders) {
-    seed ^= i.x + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    seed ^= i.y + 0x9e3779c9 + (seed << 6) + (seed >> 2);
-  }
-  return seed;
+int SokobanMaker::getDeepestDepth() {
+  return deepestDepth;
+}
+
+double SokobanMaker::getBestScore() {
+  return best.score;
+}
+
+PathFeatures SokobanMaker::getBestFeatures() {
+  return best.features;
+}
+
+long long SokobanMaker::getSearchNanos() {
+  return searchNanos;
 }
 
 bool SokobanMaker::isFree(Vec2 pos) {
-  return pos.inRectangle(workArea) && level[pos] == '.';
+  return bits.isFree(pos);
+}
+
+bool SokobanMaker::shouldStop() const {
+  return (hasDeadline && chrono::steady_clock::now() >= deadline) || (stopFlag && *stopFlag);
+}
+
+// Same order as Vec2::directions4(), so shuffling indices consumes the random generator the same way.
+static const Vec2 directions[] = { Vec2(0, 1), Vec2(1, 0), Vec2(0, -1), Vec2(-1, 0) };
+
+SokobanMaker::SearchWorker::SearchWorker(const SokobanMaker& m, RandomGen& r) : maker(m), random(r),
+    boulders(m.boulders), bits(m.bits), boulderHash(m.boulderHash), touchCounts(m.numBoulders, 0) {
 }
 
-void SokobanMaker::moveBoulder(int depth, Vec2& curPos, set<int>& visited) {
-  if (depth > maxDepth) {
-    bestLevel = level;
-    maxDepth = depth;
-    finalPos = curPos;
+template <class Geometry>
+void SokobanMaker::search(Vec2 start) {
+  if (numSearchThreads > 1) {
+    searchParallel<Geometry>(start);
+    return;
+  }
+  SearchWorker worker(*this, random);
+  RegionMap<Geometry> regions(level.getBounds());
+  regions.load(worker.bits, workArea);
+  worker.frames.reserve(numNodes + 2);
+  worker.boulderOrders.reserve((numNodes + 2) * numBoulders);
+  worker.frames.push_back(SearchFrame{});
+  worker.enterNode(start, *visitedTable);
+  worker.moveBoulder(regions, start, *visitedTable, 0);
+  best = std::move(worker.best);
+  deepestDepth = worker.deepestDepth;
+}
+
+// Expands the first levels of the tree breadth-first on the calling thread, until there are enough
+// subtrees to keep every thread busy, and then spawns a task per subtree, on the scheduler given to
+// setScheduler() or on one started for this search. Each subtree is searched with a generator seeded by its index.
+template <class Geometry>
+void SokobanMaker::searchParallel(Vec2 start) {
+  ConcurrentTranspositionTable& visited = *concurrentVisitedTable;
+  atomic<double> sharedBestScore(best.score);
+  SearchWorker splitter(*this, random);
+  splitter.sharedBestScore = &sharedBestScore;
+  RegionMap<Geometry> regions(level.getBounds());
+  regions.load(splitter.bits, workArea);
+  splitter.frames.push_back(SearchFrame{});
+  const int maxSplitDepth = 4;
+  vector<vector<Pull>> tasks(1);
+  for (int depth = 0; depth < maxSplitDepth && tasks.size() < 8 * numSearchThreads; ++depth) {
+    vector<vector<Pull>> children;
+    for (auto& path : tasks) {
+      Vec2 curPos = splitter.replay(regions, start, path);
+      for (int index : Range(numBoulders))
+        for (int direction : Range(4)) {
+          Vec2 v = directions[direction];
+          int length = splitter.getPullLength(regions, curPos, index, v);
+          if (length == 0)
+            continue;
+          int distance = random.get(1, length + 1);
+          int checkpoint = regions.getCheckpoint();
+          splitter.pullBoulder(regions, index, v, distance);
+          Vec2 dest = splitter.boulders[index] + v;
+          if (visited.insert(splitter.boulderHash ^ zobrist.player(regions.getCanonicalCell(dest)), depth + 1)) {
+            splitter.pushFrame(checkpoint, index, direction, distance);
+            splitter.recordState(dest);
+            splitter.frames.pop_back();
+            if (--splitter.touchCounts[index] == 0)
+              --splitter.numTouched;
+            children.push_back(path);
+            children.back().push_back(Pull{uint8_t(index), uint8_t(direction), uint16_t(distance)});
+          }
+          splitter.undoPull(regions, index, v, distance, checkpoint);
+        }
+      splitter.unwind(regions);
+    }
+    tasks = std::move(children);
+  }
+  if (minDepth > 0 && splitter.deepestDepth >= minDepth)
+    tasks.clear();
+  atomic<bool> searchStop(false);
+  int seed = random.get(1 << 30);
+  unique_ptr<TaskScheduler> ownScheduler;
+  TaskScheduler* pool = scheduler;
+  if (!pool) {
+    ownScheduler.reset(new TaskScheduler(numSearchThreads));
+    pool = ownScheduler.get();
+  }
+  // Per-worker arenas: the first subtree a worker runs creates its board, which the worker's later
+  // subtrees of this search reuse after undoing the previous one.
+  struct Arena {
+    Arena(SokobanMaker& maker, atomic<double>& sharedBestScore, atomic<bool>& searchStop)
+        : worker(maker, random), regions(maker.level.getBounds()) {
+      worker.sharedBestScore = &sharedBestScore;
+      worker.sharedStop = &searchStop;
+      regions.load(worker.bits, maker.workArea);
+      worker.frames.push_back(SearchFrame{});
+    }
+    RandomGen random;
+    SearchWorker worker;
+    RegionMap<Geometry> regions;
+  };
+  vector<unique_ptr<Arena>> arenas(pool->getNumWorkers());
+  TaskGroup subtrees;
+  for (int task : All(tasks))
+    pool->spawn([&, task] {
+      unique_ptr<Arena>& arena = arenas[TaskScheduler::getWorkerIndex()];
+      if (!arena)
+        arena.reset(new Arena(*this, sharedBestScore, searchStop));
+      SearchWorker& worker = arena->worker;
+      arena->random.init(seed + task);
+      Vec2 curPos = worker.replay(arena->regions, start, tasks[task]);
+      int numBaseFrames = worker.frames.size() - 1;
+      worker.enterNode(curPos, visited);
+      worker.moveBoulder(arena->regions, curPos, visited, numBaseFrames);
+      worker.unwind(arena->regions);
+    }, subtrees, false);
+  pool->waitFor(subtrees);
+  // The counters of a shared scheduler's workers are collected by its owner.
+  if (ownScheduler) {
+    ownScheduler->join();
+    for (auto& workerStats : ownScheduler->getWorkerStats())
+      Stats::current.add(workerStats.counters);
+  }
+  best = std::move(splitter.best);
+  deepestDepth = splitter.deepestDepth;
+  for (auto& arena : arenas)
+    if (arena) {
+      deepestDepth = max(deepestDepth, arena->worker.deepestDepth);
+      if (arena->worker.best.score > best.score)
+        best = std::move(arena->worker.best);
+    }
+}
+
+template <class Regions>
+int SokobanMaker::SearchWorker::getPullLength(const Regions& regions, Vec2 curPos, int index, Vec2 v) const {
+  Vec2 boulderPos = boulders[index];
+  if (!regions.sameRegion(curPos, boulderPos + v) || (boulderPos.x >= maker.middleLine - 1 && v.x > 0))
+    return 0;
+  Vec2 pos = boulderPos + v;
+  return bits.freeRun(pos, v, v.x > 0 ? maker.middleLine - pos.x : numeric_limits<int>::max());
+}
+
+template <class Regions>
+void SokobanMaker::SearchWorker::pullBoulder(Regions& regions, int index, Vec2 dir, int distance) {
+  Vec2 from = boulders[index];
+  Vec2 to = from + dir * distance;
+  // Reversed pulls are valid pushes, so the search can't put a boulder on a dead cell, and needs no
+  // DeadlockTable. The solver uses one.
+  STAT_ADD(pullsApplied, 1);
+  boulders[index] = to;
+  bits.moveBoulder(from, to);
+  regions.unblock(from);
+  regions.block(to);
+  boulderHash ^= maker.zobrist.boulder(from) ^ maker.zobrist.boulder(to);
+}
+
+template <class Regions>
+void SokobanMaker::SearchWorker::undoPull(Regions& regions, int index, Vec2 dir, int distance, int checkpoint) {
+  Vec2 to = boulders[index];
+  Vec2 from = to - dir * distance;
+  bits.moveBoulder(to, from);
+  regions.rollback(checkpoint);
+  boulderHash ^= maker.zobrist.boulder(from) ^ maker.zobrist.boulder(to);
+  boulders[index] = from;
+}
+
+// Whether a boulder pulled from 'from' passes over or stops on a door cell. There are fewer doors than
+// rooms, so this is constant time per pull.
+bool SokobanMaker::SearchWorker::crossesDoor(Vec2 from, Vec2 dir, int distance) const {
+  for (Vec2 door : maker.doors) {
+    Vec2 offset = door - from;
+    int steps = offset.x * dir.x + offset.y * dir.y;
+    if (steps >= 1 && steps <= distance && offset == dir * steps)
+      return true;
   }
-  if (visited.size() > numNodes)
+  return false;
+}
+
+void SokobanMaker::SearchWorker::pushFrame(int checkpoint, int index, int direction, int distance) {
+  const SearchFrame& parent = frames.back();
+  bool sameBoulder = frames.size() > 1 && parent.pulledBoulder == index;
+  bool sameLine = sameBoulder && parent.pulledDirection == direction;
+  Vec2 v = directions[direction];
+  if (touchCounts[index]++ == 0)
+    ++numTouched;
+  frames.push_back(SearchFrame{checkpoint, uint16_t(distance), uint8_t(index), uint8_t(direction), 0, 0, 0,
+      parent.boxLines + !sameLine, parent.boxChanges + !sameBoulder,
+      parent.doorPulls + crossesDoor(boulders[index] - v * distance, v, distance)});
+}
+
+template <class Regions>
+Vec2 SokobanMaker::SearchWorker::replay(Regions& regions, Vec2 start, const vector<Pull>& path) {
+  Vec2 curPos = start;
+  for (Pull pull : path) {
+    Vec2 v = directions[pull.direction];
+    int checkpoint = regions.getCheckpoint();
+    pullBoulder(regions, pull.boulder, v, pull.distance);
+    pushFrame(checkpoint, pull.boulder, pull.direction, pull.distance);
+    curPos = boulders[pull.boulder] + v;
+  }
+  return curPos;
+}
+
+template <class Regions>
+void SokobanMaker::SearchWorker::unwind(Regions& regions) {
+  while (frames.size() > 1) {
+    SearchFrame done = frames.back();
+    frames.pop_back();
+    undoPull(regions, done.pulledBoulder, directions[done.pulledDirection], done.pullDistance, done.checkpoint);
+    if (--touchCounts[done.pulledBoulder] == 0)
+      --numTouched;
+  }
+  boulderOrders.clear();
+}
+
+void SokobanMaker::SearchWorker::recordState(Vec2 curPos) {
+  int depth = frames.size() - 1;
+  deepestDepth = max(deepestDepth, depth);
+  // States with fewer than two pulls are never kept, whatever their score.
+  if (depth <= 1)
     return;
-  BfSearch bfSearch(distanceTable, workArea, curPos, [&](Vec2 pos) { return isFree(pos);}, Vec2::directions4());
-  for (Vec2 boulderPos : random.permutation(boulders)) {
-    for (Vec2 v : Vec2::directions4(random)) {
-      if (!bfSearch.isReachable(boulderPos + v) || (boulderPos.x >= middleLine - 1 && v.x > 0))
+  const SearchFrame& frame = frames.back();
+  PathFeatures features;
+  features.depth = depth;
+  features.boxLines = frame.boxLines;
+  features.boxChanges = frame.boxChanges;
+  features.bouldersTouched = numTouched;
+  features.doorPulls = frame.doorPulls;
+  double score = maker.weights.getScore(features);
+  if (score <= best.score)
+    return;
+  if (sharedBestScore) {
+    double shared = sharedBestScore->load(memory_order_relaxed);
+    do {
+      if (score <= shared)
+        return;
+    } while (!sharedBestScore->compare_exchange_weak(shared, score, memory_order_relaxed));
+  }
+  best.boulders = boulders;
+  best.playerPos = curPos;
+  best.depth = depth;
+  best.score = score;
+  best.features = features;
+}
+
+template <class Visited>
+void SokobanMaker::SearchWorker::enterNode(Vec2 curPos, Visited& visited) {
+  STAT_ADD(nodesExpanded, 1);
+  recordState(curPos);
+  SearchFrame& frame = frames.back();
+  frame.directionIter = 0;
+  if ((maker.hasDeadline || maker.stopFlag || sharedStop) && --nodesUntilDeadlineCheck <= 0) {
+    const int deadlineCheckInterval = 256;
+    nodesUntilDeadlineCheck = deadlineCheckInterval;
+    if ((maker.hasDeadline && chrono::steady_clock::now() >= maker.deadline)
+        || (maker.stopFlag && maker.stopFlag->load(memory_order_relaxed))
+        || (sharedStop && sharedStop->load(memory_order_relaxed)))
+      stopped = true;
+  }
+  if (maker.minDepth > 0 && !stopped) {
+    if (deepestDepth >= maker.minDepth) {
+      stopped = true;
+      if (sharedStop)
+        sharedStop->store(true, memory_order_relaxed);
+    }
+    // Every node below the stack costs a visited entry, so no state can be deeper than this.
+    int depth = frames.size() - 1;
+    if (depth + maker.numNodes + 1 - visited.getSize() < maker.minDepth)
+      stopped = true;
+  }
+  if (stopped || visited.getSize() > maker.numNodes) {
+    frame.boulderIter = maker.numBoulders;
+    return;
+  }
+  frame.boulderIter = 0;
+  int numBoulders = maker.numBoulders;
+  boulderOrders.resize((frames.size() - 1) * numBoulders);
+  for (int i : Range(numBoulders))
+    boulderOrders.push_back(i);
+  random.shuffle(boulderOrders.end() - numBoulders, boulderOrders.end());
+}
+
+// Iterative depth-first search over pulls. It visits nodes and draws random numbers in the same order as
+// a recursive search would, but keeps only a few bytes per level on an explicit stack.
+template <class Regions, class Visited>
+void SokobanMaker::SearchWorker::moveBoulder(Regions& regions, Vec2 curPos, Visited& visited, int numBaseFrames) {
+  int numBoulders = maker.numBoulders;
+  CHECK(numBoulders < 256);
+  STAT_TIMER(searchNanos);
+  while (int(frames.size()) > numBaseFrames) {
+    int depth = frames.size() - 1;
+    SearchFrame& frame = frames.back();
+    bool descended = false;
+    // Once stopped, the remaining siblings on the stack are skipped, so the search unwinds right away.
+    while (frame.boulderIter < numBoulders && !stopped) {
+      if (frame.directionIter == 4) {
+        ++frame.boulderIter;
+        frame.directionIter = 0;
         continue;
-      Vec2 pos = boulderPos + v;
-      Vec2 dest(-100, -1);
-      for (int i = 1; isFree(pos + v * i) && (v.x <= 0 || pos.x + v.x * i <= middleLine); ++i)
-        dest = pos + v * random.get(1, i + 1);
-      if (dest.x == -100)
+      }
+      if (frame.directionIter == 0) {
+        uint8_t order[] = {0, 1, 2, 3};
+        random.shuffle(order, order + 4);
+        frame.directionOrder = order[0] | (order[1] << 2) | (order[2] << 4) | (order[3] << 6);
+      }
+      int direction = (frame.directionOrder >> (2 * frame.directionIter++)) & 3;
+      int index = boulderOrders[depth * numBoulders + frame.boulderIter];
+      Vec2 v = directions[direction];
+      STAT_ADD(pullsAttempted, 1);
+      int length = getPullLength(regions, curPos, index, v);
+      if (length == 0)
         continue;
-      CHECK(level[dest] == '.');
-      CHECK(level[pos - v] == '0');
-      int boulderIndex = findElement(boulders, pos - v);
-      boulders[boulderIndex] = dest - v;
-      level[dest - v] = '0';
-      level[pos - v] = '.';
-      Vec2 prevPos = curPos;
-      curPos = dest;
-      int hash = getHash(boulders, curPos);
-      if (!visited.count(hash)) {
-        visited.insert(hash);
-        moveBoulder(depth + 1, curPos, visited);
+      int distance = random.get(1, length + 1);
+      int checkpoint = regions.getCheckpoint();
+      pullBoulder(regions, index, v, distance);
+      Vec2 dest = boulders[index] + v;
+      if (visited.insert(boulderHash ^ maker.zobrist.player(regions.getCanonicalCell(dest)), depth + 1)) {
+        pushFrame(checkpoint, index, direction, distance);
+        curPos = dest;
+        enterNode(curPos, visited);
+        descended = true;
+        break;
+      }
+      STAT_ADD(visitedHits, 1);
+      undoPull(regions, index, v, distance, checkpoint);
+    }
+    if (!descended) {
+      SearchFrame done = frames.back();
+      frames.pop_back();
+      boulderOrders.resize(frames.size() * numBoulders);
+      if (!frames.empty()) {
+        Vec2 v = directions[done.pulledDirection];
+        undoPull(regions, done.pulledBoulder, v, done.pullDistance, done.checkpoint);
+        if (--touchCounts[done.pulledBoulder] == 0)
+          --numTouched;
+        // Any cell of the parent's region identifies it, and the player stood next to the boulder.
+        curPos = boulders[done.pulledBoulder] + v;
       }
-      CHECK(level[pos - v] == '.');
-      CHECK(level[dest - v] == '0');
-      level[dest - v] = '.';
-      level[pos - v] = '0';
-      boulders[boulderIndex] = pos - v;
-      curPos = prevPos;
     }
   }
 }
@@ -1,7 +1,38 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <limits>
 #include "util.h"
 #include "bfsearch.h"
+#include "bitboard.h"
+#include "zobrist.h"
+#include "regions.h"
+#include "transposition.h"
+#include "scheduler.h"
+
+// Running features of the pull sequence that leads to a search state. A box line is a maximal run of
+// pulls of one boulder in one direction, and a box change is a pull of another boulder than the last.
+struct PathFeatures {
+  int depth = 0;
+  int boxLines = 0;
+  int boxChanges = 0;
+  int bouldersTouched = 0;
+  // Pulls that move a boulder over a door cell between two rooms.
+  int doorPulls = 0;
+};
+
+// The search keeps the state with the highest score. The default weights rank states by depth alone.
+struct ScoreWeights {
+  double depth = 1;
+  double boxLines = 0;
+  double boxChanges = 0;
+  double bouldersTouched = 0;
+  double doorPulls = 0;
+
+  double getScore(const PathFeatures&) const;
+  bool isDepthOnly() const;
+};
 
 class SokobanMaker {
   public:
@@ -9,28 +40,154 @@ class SokobanMaker {
 
   SokobanMaker& setNumRooms(int);
   SokobanMaker& setNumDoors(int);
+  // Lets consecutive searches share one preallocated table instead of each creating its own. A split
+  // search uses the concurrent one, a single-threaded search the other.
+  SokobanMaker& setVisitedTable(TranspositionTable&);
+  SokobanMaker& setVisitedTable(ConcurrentTranspositionTable&);
+  SokobanMaker& setScoreWeights(const ScoreWeights&);
+  // Splits each search at its first few levels across this many threads. The threads share the
+  // visited set, so which states they reach first, and the result, differ from run to run.
+  SokobanMaker& setNumSearchThreads(int);
+  // Runs the subtrees of a split search as tasks of this scheduler, rather than on threads started for
+  // this search alone. make() may be called from one of the scheduler's tasks or from another thread.
+  SokobanMaker& setScheduler(TaskScheduler*);
+  // Stops the search once this time has passed, keeping the best state found so far. The clock is only
+  // read every few hundred nodes.
+  SokobanMaker& setDeadline(chrono::steady_clock::time_point);
+  // Stops the search at the first state with at least this many pulls, and gives up on it as soon as
+  // the rest of the node budget can't reach that depth anymore. The best state is still picked by
+  // score, so with other weights it can be shallower.
+  SokobanMaker& setMinDepth(int);
+  // Stops the search like a deadline once the flag is set, e.g. by another thread.
+  SokobanMaker& setStopFlag(const atomic<bool>*);
 
   bool make();
   Table<char> getResult();
+  // Depth of the best state, which is the deepest one unless setScoreWeights() says otherwise.
   int getMaxDepth();
+  // Depth of the deepest state the search reached, which is what setMinDepth() is compared with.
+  int getDeepestDepth();
+  double getBestScore();
+  PathFeatures getBestFeatures();
+  // Time the last make() spent in the pull search, without the room layout and the final drawing.
+  long long getSearchNanos();
 
   private:
+  bool build();
   void prepareBoulderRooms(Rectangle area, Range mainWidth, Range otherWidth);
   int middleLine;
   Rectangle workArea = Rectangle(1, 1);
+  // Initial boulder positions. The search moves the copies held by its workers.
   vector<Vec2> boulders;
   RandomGen& random;
   Table<char> level;
   Table<char> bestLevel;
-  Vec2 finalPos;
-  int maxDepth = 1;
-  void moveBoulder(int depth, Vec2& curPos, set<int>& visited);
+  // The best state is kept as boulder positions, and bestLevel is only drawn from it once the search ends.
+  struct BestState {
+    vector<Vec2> boulders;
+    Vec2 playerPos;
+    int depth = 1;
+    double score = -numeric_limits<double>::infinity();
+    PathFeatures features;
+  };
+  BestState best;
+  int deepestDepth = 0;
+  BitBoard bits;
+  ScoreWeights weights;
+  // Door cells carved by prepareBoulderRooms().
+  vector<Vec2> doors;
+  // One level of the depth-first search. The pull that led into the node is kept so it can be undone,
+  // and the iteration state replaces the loop variables of a recursive search.
+  struct SearchFrame {
+    int checkpoint;
+    uint16_t pullDistance;
+    uint8_t pulledBoulder;
+    uint8_t pulledDirection;
+    uint8_t boulderIter;
+    uint8_t directionIter;
+    uint8_t directionOrder;
+    // Features of the path up to this node, except for bouldersTouched, which is kept in numTouched.
+    int boxLines;
+    int boxChanges;
+    int doorPulls;
+  };
+  struct Pull {
+    uint8_t boulder;
+    uint8_t direction;
+    uint16_t distance;
+  };
+  // Everything a depth-first search changes as it goes. The sequential search runs one worker on the
+  // maker's random generator, and the parallel one gives each thread its own worker.
+  struct SearchWorker {
+    SearchWorker(const SokobanMaker&, RandomGen&);
+    // Searches below the last frame until the subtree is exhausted. The first numBaseFrames frames are
+    // left on the stack.
+    template <class Regions, class Visited>
+    void moveBoulder(Regions&, Vec2 curPos, Visited&, int numBaseFrames);
+    template <class Visited>
+    void enterNode(Vec2 curPos, Visited&);
+    void recordState(Vec2 curPos);
+    // Returns the length of the longest pull of the boulder in the given direction, 0 if it can't move.
+    template <class Regions>
+    int getPullLength(const Regions&, Vec2 curPos, int index, Vec2 dir) const;
+    template <class Regions>
+    void pullBoulder(Regions&, int index, Vec2 dir, int distance);
+    template <class Regions>
+    void undoPull(Regions&, int index, Vec2 dir, int distance, int checkpoint);
+    // Pushes the frame of the node reached by a pull that was just applied.
+    void pushFrame(int checkpoint, int index, int direction, int distance);
+    // Applies the pulls from the root and returns the player position, with one frame per pull.
+    template <class Regions>
+    Vec2 replay(Regions&, Vec2 start, const vector<Pull>& path);
+    // Undoes every pull on the stack, leaving only the root frame.
+    template <class Regions>
+    void unwind(Regions&);
+    bool crossesDoor(Vec2 from, Vec2 dir, int distance) const;
+
+    const SokobanMaker& maker;
+    RandomGen& random;
+    vector<Vec2> boulders;
+    BitBoard bits;
+    uint64_t boulderHash;
+    vector<SearchFrame> frames;
+    vector<uint8_t> boulderOrders;
+    // Number of pulls of each boulder on the current path, and the number of boulders pulled at all.
+    vector<int> touchCounts;
+    int numTouched = 0;
+    BestState best;
+    int deepestDepth = 0;
+    // Best score of all workers of a parallel search. A worker only copies states that beat it.
+    atomic<double>* sharedBestScore = nullptr;
+    // Set once the deadline has passed or the minimum depth was reached or became unreachable, after
+    // which no more nodes are expanded.
+    bool stopped = false;
+    int nodesUntilDeadlineCheck = 0;
+    // Set by the worker of a parallel search that reaches the minimum depth, to stop the others.
+    atomic<bool>* sharedStop = nullptr;
+  };
+  // The search is compiled separately for each Geometry of RegionMap, see make().
+  template <class Geometry>
+  void search(Vec2 start);
+  template <class Geometry>
+  void searchParallel(Vec2 start);
   bool isFree(Vec2 pos);
-  int getHash(const vector<Vec2>& boulders, Vec2 curPos);
+  // Whether the deadline has passed or the stop flag is set, so make() shouldn't start more work.
+  bool shouldStop() const;
+  ZobristKeys zobrist;
+  uint64_t boulderHash = 0;
   int numNodes;
   int numBoulders;
-  DistanceTable distanceTable;
+  TranspositionTable* visitedTable = nullptr;
+  unique_ptr<TranspositionTable> ownVisitedTable;
+  ConcurrentTranspositionTable* concurrentVisitedTable = nullptr;
+  unique_ptr<ConcurrentTranspositionTable> ownConcurrentVisitedTable;
   int numRooms = 3;
   int numDoors = 12345;
+  int numSearchThreads = 1;
+  long long searchNanos = 0;
+  TaskScheduler* scheduler = nullptr;
+  bool hasDeadline = false;
+  chrono::steady_clock::time_point deadline;
+  int minDepth = 0;
+  const atomic<bool>* stopFlag = nullptr;
 };
-
@@ -0,0 +1,193 @@
+#include "solver.h"
+#include <queue>
+
+static const Vec2 directions[] = { Vec2(0, 1), Vec2(1, 0), Vec2(0, -1), Vec2(-1, 0) };
+
+SokobanSolver::SokobanSolver(const Table<char>& level) : bounds(level.getBounds()), board(level),
+    holeIndex(bounds, -1), pushDistances(level), bound(pushDistances), fillBound(pushDistances), deadlocks(level),
+    reachable(bounds), zobrist(bounds) {
+  vector<uint16_t> initial;
+  Vec2 player;
+  for (Vec2 v : bounds)
+    switch (board[v]) {
+      case '0':
+        initial.push_back(getIndex(v));
+        board[v] = '.';
+        break;
+      case '@':
+        player = v;
+        board[v] = '.';
+        break;
+      case '^':
+        holeIndex[v] = holes.size();
+        holes.push_back(v);
+        break;
+    }
+  CHECK(holes.size() <= 64);
+  for (Vec2 v : bounds)
+    reachable.setPassable(v, isWalkable(v));
+  numBoulders = initial.size();
+  stride = numBoulders + 1;
+  initial.push_back(getIndex(player));
+  addNode(initial.data(), 0);
+}
+
+int SokobanSolver::getIndex(Vec2 v) const {
+  return (v.y - bounds.top()) * bounds.width() + v.x - bounds.left();
+}
+
+Vec2 SokobanSolver::getPos(int index) const {
+  return Vec2(index % bounds.width() + bounds.left(), index / bounds.width() + bounds.top());
+}
+
+bool SokobanSolver::isWall(Vec2 v) const {
+  return !v.inRectangle(bounds) || board[v] == '#' || board[v] == '+';
+}
+
+bool SokobanSolver::isWalkable(Vec2 v) const {
+  return v.inRectangle(bounds) && board[v] == '.';
+}
+
+int SokobanSolver::addNode(const uint16_t* cells, uint64_t filled) {
+  pool.insert(pool.end(), cells, cells + stride);
+  filledMasks.push_back(filled);
+  return filledMasks.size() - 1;
+}
+
+int SokobanSolver::getNumExpanded() const {
+  return numExpanded;
+}
+
+void SokobanSolver::setDeadline(chrono::steady_clock::time_point d) {
+  hasDeadline = true;
+  deadline = d;
+}
+
+bool SokobanSolver::isOutOfTime() const {
+  return outOfTime;
+}
+
+namespace {
+struct OpenNode {
+  int f;
+  int g;
+  int node;
+  bool operator < (const OpenNode& other) const {
+    return f > other.f || (f == other.f && g < other.g);
+  }
+};
+}
+
+int SokobanSolver::solve(int maxExpanded) {
+  uint64_t allFilled = holes.size() == 64 ? ~uint64_t(0) : (uint64_t(1) << holes.size()) - 1;
+  TranspositionTable closed(maxExpanded);
+  priority_queue<OpenNode> open;
+  vector<uint16_t> cells(stride);
+  vector<uint16_t> child(stride);
+  vector<Vec2> active;
+  vector<int> rows(numBoulders);
+  for (int i : Range(numBoulders))
+    active.push_back(getPos(pool[i]));
+  bound.reset(active, 0);
+  if (bound.getCost() >= AssignmentBound::infinity)
+    return -1;
+  open.push(OpenNode{bound.getCost(), 0, 0});
+  outOfTime = false;
+  // The clock is only read every few hundred nodes.
+  int nodesUntilDeadlineCheck = 0;
+  while (!open.empty()) {
+    if (hasDeadline && --nodesUntilDeadlineCheck <= 0) {
+      nodesUntilDeadlineCheck = 256;
+      if (chrono::steady_clock::now() >= deadline) {
+        outOfTime = true;
+        return -1;
+      }
+    }
+    OpenNode cur = open.top();
+    open.pop();
+    uint64_t filled = filledMasks[cur.node];
+    if (filled == allFilled)
+      return cur.g;
+    std::copy(pool.begin() + cur.node * stride, pool.begin() + (cur.node + 1) * stride, cells.begin());
+    for (int i : Range(holes.size()))
+      if (filled & (uint64_t(1) << i)) {
+        board[holes[i]] = '.';
+        reachable.setPassable(holes[i], true);
+      }
+    for (int i : Range(numBoulders))
+      if (cells[i] != noBoulder) {
+        board[getPos(cells[i])] = '0';
+        reachable.setPassable(getPos(cells[i]), false);
+      }
+    reachable.fill(getPos(cells[numBoulders]));
+    uint64_t key = zobrist.player(reachable.getMinReached());
+    for (int i : Range(numBoulders))
+      if (cells[i] != noBoulder)
+        key ^= zobrist.boulder(getPos(cells[i]));
+    for (int i : Range(holes.size()))
+      if (filled & (uint64_t(1) << i))
+        key ^= zobrist.hole(holes[i]);
+    if (closed.insert(key, cur.g) && ++numExpanded <= maxExpanded) {
+      active.clear();
+      for (int i : Range(numBoulders))
+        if (cells[i] != noBoulder) {
+          rows[i] = active.size();
+          active.push_back(getPos(cells[i]));
+        }
+      bound.reset(active, filled);
+      for (int i : Range(numBoulders)) {
+        if (cells[i] == noBoulder)
+          continue;
+        Vec2 boulder = getPos(cells[i]);
+        for (Vec2 dir : directions) {
+          Vec2 to = boulder + dir;
+          if (!reachable.isReached(boulder - dir) || isWall(to) || board[to] == '0')
+            continue;
+          child = cells;
+          child[numBoulders] = getIndex(boulder);
+          uint64_t childFilled = filled;
+          int childH;
+          if (board[to] == '^') {
+            child[i] = noBoulder;
+            childFilled |= uint64_t(1) << holeIndex[to];
+            // Filling a hole removes a row and a column, so the smaller matching is solved again.
+            active.erase(active.begin() + rows[i]);
+            fillBound.reset(active, childFilled);
+            active.insert(active.begin() + rows[i], boulder);
+            childH = fillBound.getCost();
+          } else {
+            if (deadlocks.isDead(to))
+              continue;
+            board[boulder] = '.';
+            board[to] = '0';
+            bool frozen = deadlocks.isFrozen(to, [&](Vec2 pos) { return board[pos] == '0';});
+            board[to] = '.';
+            board[boulder] = '0';
+            if (frozen)
+              continue;
+            child[i] = getIndex(to);
+            bound.moveBoulder(rows[i], to);
+            childH = bound.getCost();
+            bound.moveBoulder(rows[i], boulder);
+          }
+          if (childH >= AssignmentBound::infinity)
+            continue;
+          open.push(OpenNode{cur.g + 1 + childH, cur.g + 1, addNode(child.data(), childFilled)});
+        }
+      }
+    }
+    for (int i : Range(numBoulders))
+      if (cells[i] != noBoulder) {
+        board[getPos(cells[i])] = '.';
+        reachable.setPassable(getPos(cells[i]), true);
+      }
+    for (int i : Range(holes.size()))
+      if (filled & (uint64_t(1) << i)) {
+        board[holes[i]] = '^';
+        reachable.setPassable(holes[i], false);
+      }
+    if (numExpanded > maxExpanded)
+      return -1;
+  }
+  return -1;
+}
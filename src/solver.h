@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "util.h"
+#include "floodfill.h"
+#include "transposition.h"
+#include "zobrist.h"
+#include "deadlocks.h"
+#include "heuristic.h"
+
+// A* search over pushes for levels produced by SokobanMaker. A boulder pushed into a hole fills it and
+// disappears, and the level is solved once every hole is filled. Each push moves a boulder by one cell.
+class SokobanSolver {
+  public:
+  SokobanSolver(const Table<char>& level);
+
+  // Returns the minimal number of pushes, or -1 if there is no solution or none was found within
+  // maxExpanded nodes.
+  int solve(int maxExpanded);
+  int getNumExpanded() const;
+  // Makes solve() give up like at the node limit once this time has passed.
+  void setDeadline(chrono::steady_clock::time_point);
+  // Whether the last solve() gave up because of the deadline.
+  bool isOutOfTime() const;
+
+  private:
+  // Nodes are stored in a flat pool: the cell index of every boulder (or noBoulder once it filled a hole)
+  // followed by the player's cell, plus a separate mask of filled holes.
+  static const uint16_t noBoulder = 0xffff;
+  int getIndex(Vec2) const;
+  Vec2 getPos(int index) const;
+  bool isWall(Vec2) const;
+  bool isWalkable(Vec2) const;
+  int addNode(const uint16_t* cells, uint64_t filled);
+  Rectangle bounds;
+  Table<char> board;
+  vector<Vec2> holes;
+  Table<int> holeIndex;
+  PushDistances pushDistances;
+  AssignmentBound bound;
+  AssignmentBound fillBound;
+  DeadlockTable deadlocks;
+  int numBoulders = 0;
+  int stride = 0;
+  vector<uint16_t> pool;
+  vector<uint64_t> filledMasks;
+  // Floor cells the player can walk on, updated with the boulders and filled holes of each node.
+  FloodFill reachable;
+  ZobristKeys zobrist;
+  int numExpanded = 0;
+  bool hasDeadline = false;
+  chrono::steady_clock::time_point deadline;
+  bool outOfTime = false;
+};
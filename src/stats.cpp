@@ -0,0 +1,42 @@
+#include "stats.h"
+
+using namespace std;
+
+thread_local Stats Stats::current;
+
+void Stats::add(const Stats& o) {
+  makeCalls += o.makeCalls;
+  failedMakes += o.failedMakes;
+  nodesExpanded += o.nodesExpanded;
+  visitedHits += o.visitedHits;
+  pullsAttempted += o.pullsAttempted;
+  pullsApplied += o.pullsApplied;
+  bfsCellsPopped += o.bfsCellsPopped;
+  makeNanos += o.makeNanos;
+  failedMakeNanos += o.failedMakeNanos;
+  roomsNanos += o.roomsNanos;
+  searchNanos += o.searchNanos;
+}
+
+static string seconds(long long nanos) {
+  return to_string(nanos * 1e-9);
+}
+
+string Stats::getJsonFields() const {
+  return "\"make_calls\": " + to_string(makeCalls) +
+      ", \"failed_makes\": " + to_string(failedMakes) +
+      ", \"nodes_expanded\": " + to_string(nodesExpanded) +
+      ", \"visited_hits\": " + to_string(visitedHits) +
+      ", \"pulls_attempted\": " + to_string(pullsAttempted) +
+      ", \"pulls_applied\": " + to_string(pullsApplied) +
+      ", \"bfs_cells_popped\": " + to_string(bfsCellsPopped) +
+      ", \"make_seconds\": " + seconds(makeNanos) +
+      ", \"failed_make_seconds\": " + seconds(failedMakeNanos) +
+      ", \"rooms_seconds\": " + seconds(roomsNanos) +
+      ", \"search_seconds\": " + seconds(searchNanos);
+}
+
+long long Stats::getNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include "util.h"
+
+// Counters of the generator's hot paths, kept per thread. They are only updated in builds made with
+// STATS=true, and the STAT_* macros compile to nothing otherwise.
+struct Stats {
+  long long makeCalls;
+  long long failedMakes;
+  long long nodesExpanded;
+  long long visitedHits;
+  long long pullsAttempted;
+  long long pullsApplied;
+  long long bfsCellsPopped;
+  long long makeNanos;
+  long long failedMakeNanos;
+  long long roomsNanos;
+  long long searchNanos;
+
+  void add(const Stats&);
+  // Fields of a JSON object, without the enclosing braces.
+  string getJsonFields() const;
+
+  static long long getNanos();
+  static thread_local Stats current;
+#ifdef SOKOBAN_STATS
+  static constexpr bool enabled = true;
+#else
+  static constexpr bool enabled = false;
+#endif
+};
+
+// Adds the lifetime of the object to a nanosecond counter.
+class StatTimer {
+  public:
+  StatTimer(long long& t) : target(t), start(Stats::getNanos()) {}
+  ~StatTimer() { target += Stats::getNanos() - start; }
+
+  private:
+  long long& target;
+  long long start;
+};
+
+#ifdef SOKOBAN_STATS
+#define STAT_ADD(counter, value) (Stats::current.counter += (value))
+#define STAT_TIMER(counter) StatTimer statTimer_##counter(Stats::current.counter)
+#else
+#define STAT_ADD(counter, value) ((void) 0)
+#define STAT_TIMER(counter) ((void) 0)
+#endif
@@ -0,0 +1,138 @@
+#include "transposition.h"
+
+TranspositionTable::TranspositionTable(int expectedSize) {
+  int capacity = 16;
+  while (capacity < 2 * expectedSize)
+    capacity *= 2;
+  slots.resize(capacity, Slot{0, 0, 0});
+  mask = capacity - 1;
+}
+
+void TranspositionTable::clear() {
+  if (++generation == 0) {
+    for (auto& slot : slots)
+      slot.generation = 0;
+    generation = 1;
+  }
+  size = 0;
+}
+
+// The keys are random Zobrist hashes, so their low bits are used directly as the home slot.
+int TranspositionTable::findSlot(uint64_t key, int& probes) const {
+  probes = 1;
+  for (uint64_t index = key & mask;; index = (index + 1) & mask, ++probes) {
+    const Slot& slot = slots[index];
+    if (slot.generation != generation || slot.key == key)
+      return index;
+  }
+}
+
+bool TranspositionTable::insert(uint64_t key, int depth) {
+  if (2 * (size + 1) > slots.size())
+    grow();
+  int probes;
+  Slot& slot = slots[findSlot(key, probes)];
+  ++numLookups;
+  numProbes += probes;
+  maxProbes = max(maxProbes, probes);
+  if (slot.generation == generation)
+    return false;
+  slot = Slot{key, generation, depth};
+  ++size;
+  return true;
+}
+
+int TranspositionTable::getDepth(uint64_t key) const {
+  int probes;
+  const Slot& slot = slots[findSlot(key, probes)];
+  return slot.generation == generation ? slot.depth : -1;
+}
+
+void TranspositionTable::grow() {
+  vector<Slot> old(2 * slots.size(), Slot{0, 0, 0});
+  old.swap(slots);
+  mask = slots.size() - 1;
+  for (auto& slot : old)
+    if (slot.generation == generation) {
+      int probes;
+      slots[findSlot(slot.key, probes)] = slot;
+    }
+}
+
+int TranspositionTable::getSize() const {
+  return size;
+}
+
+int TranspositionTable::getCapacity() const {
+  return slots.size();
+}
+
+double TranspositionTable::getLoad() const {
+  return double(size) / slots.size();
+}
+
+double TranspositionTable::getAverageProbes() const {
+  return numLookups == 0 ? 0 : double(numProbes) / numLookups;
+}
+
+int TranspositionTable::getMaxProbes() const {
+  return maxProbes;
+}
+
+ConcurrentTranspositionTable::ConcurrentTranspositionTable(int expectedSize) : size(0) {
+  capacity = 16;
+  while (capacity < 2 * expectedSize)
+    capacity *= 2;
+  keys.reset(new atomic<uint64_t>[capacity]);
+  mask = capacity - 1;
+  for (int i : Range(capacity))
+    keys[i].store(0, memory_order_relaxed);
+}
+
+void ConcurrentTranspositionTable::clear() {
+  if (++generation == uint64_t(1) << (64 - generationShift)) {
+    for (int i : Range(capacity))
+      keys[i].store(0, memory_order_relaxed);
+    generation = 1;
+  }
+  size.store(0);
+}
+
+// Generation 0 never occurs, so zeroed slots are empty.
+uint64_t ConcurrentTranspositionTable::getStoredKey(uint64_t key) const {
+  return (generation << generationShift) | (key & keyMask);
+}
+
+bool ConcurrentTranspositionTable::isCurrent(uint64_t stored) const {
+  return stored >> generationShift == generation;
+}
+
+bool ConcurrentTranspositionTable::insert(uint64_t key, int) {
+  key = getStoredKey(key);
+  if (2 * (size.load(memory_order_relaxed) + 1) > capacity)
+    return false;
+  for (uint64_t index = key & mask;; index = (index + 1) & mask) {
+    uint64_t current = keys[index].load(memory_order_relaxed);
+    if (!isCurrent(current)) {
+      if (keys[index].compare_exchange_strong(current, key, memory_order_relaxed)) {
+        size.fetch_add(1, memory_order_relaxed);
+        return true;
+      }
+      // Lost the slot to another thread, which may have inserted the same key.
+    }
+    if (current == key)
+      return false;
+  }
+}
+
+int ConcurrentTranspositionTable::getSize() const {
+  return size.load(memory_order_relaxed);
+}
+
+int ConcurrentTranspositionTable::getCapacity() const {
+  return capacity;
+}
+
+double ConcurrentTranspositionTable::getLoad() const {
+  return double(getSize()) / capacity;
+}
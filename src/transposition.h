@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "util.h"
+
+// Open-addressing hash set of 64-bit state keys, with the depth at which each state was first reached.
+// Slots are stamped with a generation number, so clearing the table between searches is O(1). The
+// table only grows if a search overshoots the capacity it was sized for.
+class TranspositionTable {
+  public:
+  TranspositionTable(int expectedSize);
+
+  void clear();
+  // Returns false if the key was already present.
+  bool insert(uint64_t key, int depth);
+  // Returns -1 if the key is not present.
+  int getDepth(uint64_t key) const;
+
+  int getSize() const;
+  int getCapacity() const;
+  double getLoad() const;
+  double getAverageProbes() const;
+  int getMaxProbes() const;
+
+  private:
+  struct Slot {
+    uint64_t key;
+    uint32_t generation;
+    int depth;
+  };
+  int findSlot(uint64_t key, int& numProbes) const;
+  void grow();
+  vector<Slot> slots;
+  uint64_t mask;
+  uint32_t generation = 1;
+  int size = 0;
+  long long numLookups = 0;
+  long long numProbes = 0;
+  int maxProbes = 0;
+};
+
+// The same set for several threads searching at once. Keys are claimed with a compare-and-swap, so an
+// insert never blocks and exactly one thread sees a given key as new. The capacity is fixed: once the
+// table is half full, inserts fail as if the key had been seen, which stops the search.
+//
+// Each slot is a single word holding the generation in its top bits and the low bits of the key, so
+// like TranspositionTable, clearing is O(1) except once every 65535 generations.
+class ConcurrentTranspositionTable {
+  public:
+  ConcurrentTranspositionTable(int expectedSize);
+
+  // Not thread-safe.
+  void clear();
+  // Returns false if the key was already present. The depth isn't stored, it's only taken to match
+  // TranspositionTable::insert.
+  bool insert(uint64_t key, int depth);
+
+  int getSize() const;
+  int getCapacity() const;
+
+  double getLoad() const;
+
+  private:
+  static const int generationShift = 48;
+  static const uint64_t keyMask = (uint64_t(1) << generationShift) - 1;
+  uint64_t getStoredKey(uint64_t key) const;
+  bool isCurrent(uint64_t stored) const;
+  unique_ptr<atomic<uint64_t>[]> keys;
+  uint64_t mask;
+  int capacity;
+  uint64_t generation = 1;
+  atomic<int> size;
+};
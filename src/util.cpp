@@ -54,9 +54,6 @@ double RandomGen::getDouble(double a, double b) {
 }
 
 
-Vec2::Vec2(int _x, int _y) : x(_x), y(_y) {
-}
-
 Vec2 Vec2::mult(const Vec2& v) const {
   return Vec2(x * v.x, y * v.y);
 }
@@ -164,36 +161,6 @@ bool Rectangle::operator != (const Rectangle& r) const {
   return !(*this == r);
 }
 
-bool Vec2::inRectangle(int px, int py, int kx, int ky) const {
-  return x >= px && x < kx && y >= py && y < ky;
-}
-
-bool Vec2::inRectangle(const Rectangle& r) const {
-  return x >= r.px && x < r.kx && y >= r.py && y < r.ky;
-}
-
-bool Vec2::operator== (const Vec2& v) const {
-  return v.x == x && v.y == y;
-}
-
-bool Vec2::operator!= (const Vec2& v) const {
-  return v.x != x || v.y != y;
-}
-
-Vec2& Vec2::operator +=(const Vec2& v) {
-  x += v.x;
-  y += v.y;
-  return *this;
-}
-
-Vec2 Vec2::operator + (const Vec2& v) const {
-  return Vec2(x + v.x, y + v.y);
-}
-
-Vec2 Vec2::operator * (int a) const {
-  return Vec2(x * a, y * a);
-}
-
 Vec2 Vec2::operator * (double a) const {
   return Vec2(x * a, y * a);
 }
@@ -202,24 +169,6 @@ Vec2 Vec2::operator / (int a) const {
   return Vec2(x / a, y / a);
 }
 
-Vec2& Vec2::operator -=(const Vec2& v) {
-  x -= v.x;
-  y -= v.y;
-  return *this;
-}
-
-Vec2 Vec2::operator - (const Vec2& v) const {
-  return Vec2(x - v.x, y - v.y);
-}
-
-Vec2 Vec2::operator - () const {
-  return Vec2(-x, -y);
-}
-
-bool Vec2::operator < (Vec2 v) const {
-  return x < v.x || (x == v.x && y < v.y);
-}
-
 int Vec2::length8() const {
   return max(abs(x), abs(y));
 }
@@ -232,10 +181,6 @@ double Vec2::distD(Vec2 v) const {
   return (v - *this).lengthD();
 }
 
-int Vec2::length4() const {
-  return abs(x) + abs(y);
-}
-
 double Vec2::lengthD() const {
   return sqrt(x * x + y * y);
 }
@@ -273,82 +218,14 @@ Vec2 Vec2::getCenterOfWeight(vector<Vec2> vs) {
   return ret / vs.size();
 }
 
-Rectangle::Rectangle(int _w, int _h) : px(0), py(0), kx(_w), ky(_h), w(_w), h(_h) {
-  CHECK(w > 0 && h > 0);
-}
-
-Rectangle::Rectangle(Vec2 d) : px(0), py(0), kx(d.x), ky(d.y), w(d.x), h(d.y) {
-  CHECK(d.x > 0 && d.y > 0);
-}
-
-Rectangle::Rectangle(int px1, int py1, int kx1, int ky1) : px(px1), py(py1), kx(kx1), ky(ky1), w(kx1 - px1),
-    h(ky1 - py1) {
-  CHECK(kx > px && ky > py);
-}
-
-Rectangle::Rectangle(Vec2 p, Vec2 k) : px(p.x), py(p.y), kx(k.x), ky(k.y), w(k.x - p.x), h(k.y - p.y) {
-  CHECK(k.x > p.x);
-  CHECK(k.y > p.y);
-}
-
 Rectangle::Rectangle(Range xRange, Range yRange)
     : Rectangle(xRange.getStart(), yRange.getStart(), xRange.getEnd(), yRange.getEnd()) {
 }
 
-Rectangle::Iter::Iter(int x1, int y1, int px1, int py1, int kx1, int ky1) : pos(x1, y1), px(px1), py(py1), kx(kx1), ky(ky1) {}
-
 Vec2 Rectangle::middle() const {
   return Vec2((px + kx) / 2, (py + ky) / 2);
 }
 
-int Rectangle::left() const {
-  return px;
-}
-
-int Rectangle::top() const {
-  return py;
-}
-
-Range Rectangle::getXRange() const {
-  return Range(px, kx);
-}
-
-Range Rectangle::getYRange() const {
-  return Range(py, ky);
-}
-
-int Rectangle::right() const {
-  return kx;
-}
-
-int Rectangle::bottom() const {
-  return ky;
-}
-
-int Rectangle::width() const {
-  return w;
-}
-
-int Rectangle::height() const {
-  return h;
-}
-
-int Rectangle::area() const {
-  return w * h;
-}
-
-Vec2 Rectangle::getSize() const {
-  return Vec2(w, h);
-}
-
-Vec2 Rectangle::topLeft() const {
-  return Vec2(px, py);
-}
-
-Vec2 Rectangle::bottomRight() const {
-  return Vec2(kx, ky);
-}
-
 Vec2 Rectangle::topRight() const {
   return Vec2(kx, py);
 }
@@ -373,39 +250,6 @@ Rectangle Rectangle::translate(Vec2 v) const {
   return Rectangle(topLeft() + v, bottomRight() + v);
 }
 
-Rectangle Rectangle::minusMargin(int margin) const {
-  CHECK(px + margin < kx - margin && py + margin < ky - margin);
-  return Rectangle(px + margin, py + margin, kx - margin, ky - margin);
-}
-
-Vec2 Rectangle::Iter::operator* () const {
-  return pos;
-}
-bool Rectangle::Iter::operator != (const Iter& other) const {
-  return pos != other.pos;
-}
-
-const Rectangle::Iter& Rectangle::Iter::operator++ () {
-  ++pos.y;
-  if (pos.y >= ky) {
-    pos.y = py;
-    ++pos.x;
-  }
-  return *this;
-}
-
-Rectangle::Iter Rectangle::begin() const {
-  return Iter(px, py, px, py, kx, ky);
-}
-
-Rectangle::Iter Rectangle::end() const {
-  return Iter(kx, py, px, py, kx, ky);
-}
-
-Range::Range(int a, int b) : start(a), finish(b) {
-}
-Range::Range(int a) : Range(0, a) {}
-
 Range Range::reverse() {
   Range r(finish - 1, start - 1);
   r.increment = -1;
@@ -430,37 +274,3 @@ Range Range::shorten(int r) {
   }
 }
 
-int Range::getStart() const {
-  return start;
-}
-
-int Range::getEnd() const {
-  return finish;
-}
-
-Range::Iter Range::begin() {
-  if ((increment > 0 && start < finish) || (increment < 0 && start > finish))
-    return Iter(start, start, finish, increment);
-  else
-    return end();
-}
-
-Range::Iter Range::end() {
-  return Iter(finish, start, finish, increment);
-}
-
-Range::Iter::Iter(int i, int a, int b, int inc) : ind(i), min(a), max(b), increment(inc) {}
-
-int Range::Iter::operator* () const {
-  return ind;
-}
-
-bool Range::Iter::operator != (const Iter& other) const {
-  return other.ind != ind;
-}
-
-const Range::Iter& Range::Iter::operator++ () {
-  ind += increment;
-  //CHECK(ind <= max && ind >= min) << ind << " " << min << " " << max;
-  return *this;
-}
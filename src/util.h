@@ -135,6 +135,11 @@ class RandomGen {
     return v;
   }
 
+  template <typename Iter>
+  void shuffle(Iter begin, Iter end) {
+    random_shuffle(begin, end, [this](int a) { return get(a);});
+  }
+
   template <typename T>
   vector<T> chooseN(int n, vector<T> v) {
     CHECK(n <= v.size());
@@ -169,8 +174,8 @@ class Vec2 {
   public:
   int x;
   int y;
-  Vec2() : x(0), y(0) {}
-  Vec2(int x, int y);
+  constexpr Vec2() : x(0), y(0) {}
+  constexpr Vec2(int x, int y) : x(x), y(y) {}
   bool inRectangle(int px, int py, int kx, int ky) const;
   bool operator == (const Vec2& v) const;
   bool operator != (const Vec2& v) const;
@@ -275,6 +280,199 @@ class Rectangle {
   int px = 0, py = 0, kx = 0, ky = 0, w = 0, h = 0;
 };
 
+// The small Range, Vec2 and Rectangle operations are defined here so they can be inlined into the
+// search loops.
+
+inline Range::Range(int a, int b) : start(a), finish(b) {
+}
+
+inline Range::Range(int a) : Range(0, a) {}
+
+inline int Range::getStart() const {
+  return start;
+}
+
+inline int Range::getEnd() const {
+  return finish;
+}
+
+inline Range::Iter Range::begin() {
+  if ((increment > 0 && start < finish) || (increment < 0 && start > finish))
+    return Iter(start, start, finish, increment);
+  else
+    return end();
+}
+
+inline Range::Iter Range::end() {
+  return Iter(finish, start, finish, increment);
+}
+
+inline Range::Iter::Iter(int i, int a, int b, int inc) : ind(i), min(a), max(b), increment(inc) {}
+
+inline int Range::Iter::operator* () const {
+  return ind;
+}
+
+inline bool Range::Iter::operator != (const Iter& other) const {
+  return other.ind != ind;
+}
+
+inline const Range::Iter& Range::Iter::operator++ () {
+  ind += increment;
+  //CHECK(ind <= max && ind >= min) << ind << " " << min << " " << max;
+  return *this;
+}
+
+inline bool Vec2::inRectangle(int px, int py, int kx, int ky) const {
+  return x >= px && x < kx && y >= py && y < ky;
+}
+
+inline bool Vec2::inRectangle(const Rectangle& r) const {
+  return x >= r.px && x < r.kx && y >= r.py && y < r.ky;
+}
+
+inline bool Vec2::operator== (const Vec2& v) const {
+  return v.x == x && v.y == y;
+}
+
+inline bool Vec2::operator!= (const Vec2& v) const {
+  return v.x != x || v.y != y;
+}
+
+inline Vec2& Vec2::operator +=(const Vec2& v) {
+  x += v.x;
+  y += v.y;
+  return *this;
+}
+
+inline Vec2 Vec2::operator + (const Vec2& v) const {
+  return Vec2(x + v.x, y + v.y);
+}
+
+inline Vec2 Vec2::operator * (int a) const {
+  return Vec2(x * a, y * a);
+}
+
+inline Vec2& Vec2::operator -=(const Vec2& v) {
+  x -= v.x;
+  y -= v.y;
+  return *this;
+}
+
+inline Vec2 Vec2::operator - (const Vec2& v) const {
+  return Vec2(x - v.x, y - v.y);
+}
+
+inline Vec2 Vec2::operator - () const {
+  return Vec2(-x, -y);
+}
+
+inline bool Vec2::operator < (Vec2 v) const {
+  return x < v.x || (x == v.x && y < v.y);
+}
+
+inline int Vec2::length4() const {
+  return abs(x) + abs(y);
+}
+
+inline Rectangle::Rectangle(int _w, int _h) : px(0), py(0), kx(_w), ky(_h), w(_w), h(_h) {
+  CHECK(w > 0 && h > 0);
+}
+
+inline Rectangle::Rectangle(Vec2 d) : px(0), py(0), kx(d.x), ky(d.y), w(d.x), h(d.y) {
+  CHECK(d.x > 0 && d.y > 0);
+}
+
+inline Rectangle::Rectangle(int px1, int py1, int kx1, int ky1) : px(px1), py(py1), kx(kx1), ky(ky1), w(kx1 - px1),
+    h(ky1 - py1) {
+  CHECK(kx > px && ky > py);
+}
+
+inline Rectangle::Rectangle(Vec2 p, Vec2 k) : px(p.x), py(p.y), kx(k.x), ky(k.y), w(k.x - p.x), h(k.y - p.y) {
+  CHECK(k.x > p.x);
+  CHECK(k.y > p.y);
+}
+
+inline Rectangle::Iter::Iter(int x1, int y1, int px1, int py1, int kx1, int ky1) : pos(x1, y1), px(px1), py(py1), kx(kx1), ky(ky1) {}
+
+inline int Rectangle::left() const {
+  return px;
+}
+
+inline int Rectangle::top() const {
+  return py;
+}
+
+inline Range Rectangle::getXRange() const {
+  return Range(px, kx);
+}
+
+inline Range Rectangle::getYRange() const {
+  return Range(py, ky);
+}
+
+inline int Rectangle::right() const {
+  return kx;
+}
+
+inline int Rectangle::bottom() const {
+  return ky;
+}
+
+inline int Rectangle::width() const {
+  return w;
+}
+
+inline int Rectangle::height() const {
+  return h;
+}
+
+inline int Rectangle::area() const {
+  return w * h;
+}
+
+inline Vec2 Rectangle::getSize() const {
+  return Vec2(w, h);
+}
+
+inline Vec2 Rectangle::topLeft() const {
+  return Vec2(px, py);
+}
+
+inline Vec2 Rectangle::bottomRight() const {
+  return Vec2(kx, ky);
+}
+
+inline Rectangle Rectangle::minusMargin(int margin) const {
+  CHECK(px + margin < kx - margin && py + margin < ky - margin);
+  return Rectangle(px + margin, py + margin, kx - margin, ky - margin);
+}
+
+inline Vec2 Rectangle::Iter::operator* () const {
+  return pos;
+}
+
+inline bool Rectangle::Iter::operator != (const Iter& other) const {
+  return pos != other.pos;
+}
+
+inline const Rectangle::Iter& Rectangle::Iter::operator++ () {
+  ++pos.y;
+  if (pos.y >= ky) {
+    pos.y = py;
+    ++pos.x;
+  }
+  return *this;
+}
+
+inline Rectangle::Iter Rectangle::begin() const {
+  return Iter(px, py, px, py, kx, ky);
+}
+
+inline Rectangle::Iter Rectangle::end() const {
+  return Iter(kx, py, px, py, kx, ky);
+}
+
 template <class T>
 class Table {
   public:
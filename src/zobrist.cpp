@@ -0,0 +1,24 @@
+#include "zobrist.h"
+
+ZobristKeys::ZobristKeys(Rectangle bounds) : boulderKeys(bounds), playerKeys(bounds), holeKeys(bounds) {
+  // Fixed seed, so the keys don't consume the generator's random stream and hashes are reproducible.
+  std::mt19937_64 generator(0x5eed5eed);
+  for (Vec2 v : bounds) {
+    boulderKeys[v] = generator();
+    playerKeys[v] = generator();
+  }
+  for (Vec2 v : bounds)
+    holeKeys[v] = generator();
+}
+
+uint64_t ZobristKeys::boulder(Vec2 v) const {
+  return boulderKeys[v];
+}
+
+uint64_t ZobristKeys::player(Vec2 v) const {
+  return playerKeys[v];
+}
+
+uint64_t ZobristKeys::hole(Vec2 v) const {
+  return holeKeys[v];
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include "util.h"
+
+// Random 64-bit keys for every (cell, piece) pair. A state's key is the xor of the keys of its pieces,
+// so moving one piece updates it in O(1).
+class ZobristKeys {
+  public:
+  ZobristKeys(Rectangle bounds);
+
+  uint64_t boulder(Vec2) const;
+  uint64_t player(Vec2) const;
+  uint64_t hole(Vec2) const;
+
+  private:
+  Table<uint64_t> boulderKeys;
+  Table<uint64_t> playerKeys;
+  Table<uint64_t> holeKeys;
+};